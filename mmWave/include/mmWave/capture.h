@@ -0,0 +1,224 @@
+#ifndef MMWAVE_CAPTURE_H
+#define MMWAVE_CAPTURE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "mmWave/frame_assembler.h"
+#include "mmWave/frame_pool.h"
+#include "mmWave/frame_queue.h"
+#include "mmWave/frame_view.h"
+#include "mmWave/packet_ring.h"
+#include "mmWave/uring_recv.h"
+
+namespace mmwave
+{
+
+enum capture_backend
+{
+	BACKEND_SOCKET,			// recvmmsg on a UDP socket
+	BACKEND_PACKET_RING,	// AF_PACKET TPACKET_V3 ring, needs CAP_NET_RAW
+	BACKEND_URING,			// io_uring multishot recv into provided buffers
+};
+
+struct capture_config
+{
+	std::string data_addr;	// local address the DCA1000 streams to
+	uint16_t data_port;
+	int64_t packet_size;	// CONFIG_PACKET_DATA size the board streams with
+	int64_t frame_len;		// int16 words per frame
+	int64_t ring_frames;	// frame slots in the pool, 2 are always being filled
+	bool in_place;			// receive payloads straight into the ring (socket backend)
+	int64_t reorder_window;	// full size packets a late packet may trail by
+	capture_backend backend;
+	std::string interface;	// packet ring interface, empty for the one holding data_addr
+	size_t ring_block_size;	// packet ring block bytes
+	size_t ring_blocks;
+	unsigned uring_buffers;	// datagram buffers of the io_uring backend
+	double fps;				// frame rate, with frame_len sizes the kernel buffers
+	int rcvbuf_ms;			// stream time the socket buffer or packet ring holds
+	int rt_cpu;				// cpu the receive thread is pinned to, -1 for any
+	int rt_priority;		// SCHED_FIFO priority of the receive thread, 0 for SCHED_OTHER
+	bool lock_memory;		// mlockall and prefault the frame ring before receiving
+	bool huge_pages;		// frame ring on 2 MB pages if the host has them
+	overrun_policy overrun;	// when the consumer holds every frame slot
+	int overrun_block_ms;	// longest wait for a slot with OVERRUN_BLOCK
+
+	capture_config()
+		: data_addr("192.168.33.30"), data_port(4098), packet_size(1472), frame_len(0), ring_frames(4),
+		  in_place(false), reorder_window(4), backend(BACKEND_SOCKET),
+		  ring_block_size(1 << 18), ring_blocks(128),
+		  uring_buffers(1024), fps(0), rcvbuf_ms(100),
+		  rt_cpu(-1), rt_priority(0), lock_memory(false), huge_pages(false),
+		  overrun(OVERRUN_DROP_NEWEST), overrun_block_ms(20) {}
+};
+
+// completed frame, a view into a pool slot the consumer holds a reference to
+struct frame
+{
+	int64_t slot;
+	const int16_t* data;
+	int64_t len;
+	frame_info info;
+
+	// the words as chirps records of samples samples, throws std::length_error if they do not fit
+	template <class Layout>
+	frame_view<Layout> view(size_t chirps, size_t samples) const
+	{
+		return frame_view<Layout>(data, len, chirps, samples);
+	}
+};
+
+/*
+	Owns the DCA1000 data socket and the frame ring.
+	A receive thread reads batches of raw packets with recvmmsg, cuts them into
+	frames in a frame_pool and pushes the slot of every completed frame to a
+	lock free queue, the consumer blocks in wait_frame.
+
+	The payload buffers hold a packet of packet_size, the size the DCA1000
+	was configured with, a longer datagram is dropped with a warning.
+
+	With in_place set the payloads are scattered by the kernel directly to
+	their expected position in the ring, headers go to a side buffer. Only a
+	batch with lost or short packets is copied out again and re-added.
+
+	The packet ring backend reads the datagrams from an AF_PACKET ring shared
+	with the kernel instead, without a syscall per packet. The UDP socket is
+	still bound so the port stays open, a filter drops everything it gets.
+	The io_uring backend keeps one multishot recv on the socket that fills
+	buffers from a provided buffer ring, completions are reaped in user space.
+
+	Lost packets are zero filled up to the byte count of the next packet
+	received, so frames stay aligned whatever the packet size. A packet that
+	arrives late, within reorder_window packets, is put back in its place
+	before the frame is handed out; older ones and duplicates are dropped.
+	When no packet came for IDLE_MS (the board stopped) and on stop the
+	frames still held for late packets are handed out.
+	Frame boundaries follow the absolute byte counter, so capture can start
+	while the board is already streaming and recovers from a counter restart.
+
+	The socket buffer (or the packet ring) is sized to hold rcvbuf_ms of the
+	stream at frame_len * fps. The kernel drop counter of the socket (ring)
+	is followed so every lost packet can be blamed on the host or the wire.
+	Every datagram carries its kernel receive time, frames keep the times of
+	their first and last packets in frame_info.
+
+	For loss free capture on a busy host the receive thread can be pinned to
+	an (isolated) cpu and run SCHED_FIFO, with all memory locked and the frame
+	ring faulted in before the first packet.
+
+	Frames are not copied out of the ring. A frame returned by wait_frame
+	stays valid until it is given back with release, the producer never
+	writes to it in the meantime. What happens to frames completed while the
+	consumer holds every slot is up to the overrun policy (frame_assembler),
+	all of them are counted.
+*/
+class capture
+{
+public:
+	explicit capture(const capture_config& cfg);
+	~capture();
+
+	// the queue indices are cache line aligned, plain new only guarantees 16 bytes
+	static void* operator new(size_t size);
+	static void operator delete(void* p);
+
+	// silence after which the stream is taken as stopped
+	static const int IDLE_MS = 100;
+
+	bool open();
+	void start();
+	void stop();
+
+	// receiving from a capture_group thread instead of start(): the fd that
+	// turns readable when datagrams are waiting, and a receive of at most
+	// max_packets of them that never blocks, returns how many were taken
+	int poll_fd() const;
+	int poll(int max_packets);
+	// the frames held for late packets go out, the stream was idle for IDLE_MS
+	void flush() { assembler_.flush(); }
+	bool holding_frames() const { return assembler_.held_frames() > 0; }
+	void prefault_ring();
+
+	// consumer side
+	bool wait_frame(frame& f, int timeout_ms);
+	void release(const frame& f) { pool_.release(f.slot); }
+	void wake() { queue_.wake(); }
+
+	uint64_t packets() const { return packets_; }
+	uint64_t stale_packets() const { return assembler_.stale_packets(); }
+	uint64_t zero_filled() const { return assembler_.zero_filled(); }
+	uint64_t reordered() const { return assembler_.reordered(); }
+	uint64_t resyncs() const { return assembler_.resyncs(); }
+	uint64_t kernel_drops() const { return kernel_drops_; }
+	uint64_t lost_packets() const { return assembler_.lost_packets(); }
+	uint64_t kernel_lost() const { return assembler_.kernel_lost(); }
+	uint64_t wire_lost() const { return assembler_.wire_lost(); }
+	int rcvbuf() const { return rcvbuf_; }	// bytes the kernel buffers for us
+	uint64_t frames() const { return assembler_.frames(); }
+	uint64_t dropped_frames() const { return assembler_.dropped_frames(); }
+	uint64_t overwritten_frames() const { return assembler_.overwritten_frames(); }
+	uint64_t blocked() const { return assembler_.blocked(); }
+	uint64_t block_timeouts() const { return assembler_.block_timeouts(); }
+	uint64_t blocked_ns() const { return assembler_.blocked_ns(); }
+	size_t queue_high_water() const { return queue_.high_water(); }
+	int page_mode() const { return pool_.page_mode(); }	// RING_PAGES_* of the frame ring
+
+private:
+	size_t buffer_bytes() const;
+	void size_rcvbuf();
+	void set_socket_drops(uint32_t drops);
+	void run();
+	int receive_once(bool wait);
+	int receive(bool wait);
+	int receive_in_place(bool wait);
+	int receive_packet_ring(bool wait);
+	int receive_uring(bool wait);
+	int recv_batch(int batch, bool wait);
+	bool truncated(int i);
+	void warn_truncated();
+	void add_batch(int num_msgs);
+	void add_packet(const uint8_t* header, const int16_t* payload, int64_t len, uint64_t stamp);
+
+	capture_config cfg_;
+	int64_t payload_len_;	// int16 words of a full packet, 0 if packet_size is out of range
+	int fd_;
+
+	frame_pool pool_;
+	frame_queue queue_;
+	frame_assembler assembler_;
+	packet_ring ring_;
+	uring_recv uring_;
+
+	// recvmmsg batch, headers and payloads are scattered into separate vectors
+	// (payloads go straight to the ring in the in place mode)
+	static const int MAX_BATCH = 32;
+	std::vector<uint8_t> headers_;
+	std::vector<int16_t> payloads_;
+	std::vector<int64_t> msg_lens_;
+	std::vector<uint64_t> stamps_;	// kernel receive times, ns
+	std::vector<iovec> iov_;
+	std::vector<mmsghdr> msgs_;
+	static const int CONTROL_LEN = 64;	// room for the SO_TIMESTAMPNS and SO_RXQ_OVFL cmsgs
+	std::vector<uint8_t> control_;
+
+	int rcvbuf_;
+	uint32_t socket_drops_;		// last SO_RXQ_OVFL / SK_MEMINFO_DROPS value
+	std::atomic<uint64_t> kernel_drops_;
+	bool truncated_warned_;
+
+	std::atomic<bool> running_;
+	std::atomic<uint64_t> packets_;
+	std::thread thread_;
+};
+
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef MMWAVE_CAPTURE_GROUP_H
+#define MMWAVE_CAPTURE_GROUP_H
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "mmWave/capture.h"
+
+namespace mmwave
+{
+
+/*
+	One receive thread for several DCA1000 boards.
+	Every capture keeps its own socket (or packet ring / io_uring), frame
+	ring and queue, the group waits on all of them with a single epoll and
+	drains the ones that are readable without blocking. A radar streams in
+	bursts, so most wakeups serve every board that sent something since the
+	last one and the cost of an extra radar is its packets, not a thread.
+
+	The thread sleeps in epoll_wait without a timeout while every board is
+	silent, stop() wakes it through an eventfd in the same epoll set. Only
+	while a board holds completed frames for late packets the wait times
+	out, once it was silent for capture::IDLE_MS those frames are flushed.
+
+	A burst is taken in chunks of at most BUDGET datagrams so a board that
+	never stops cannot starve the others, epoll is level triggered and
+	reports it again.
+
+	The real time settings of capture_config apply to the group thread here,
+	the ones of the captures are not used.
+*/
+class capture_group
+{
+public:
+	capture_group(int rt_cpu, int rt_priority, bool lock_memory);
+	~capture_group();
+
+	// cap is opened by the caller and outlives the group, never start()ed itself
+	bool add(capture* cap);
+	void start();
+	void stop();
+
+	uint64_t wakeups() const { return wakeups_; }
+
+private:
+	void run();
+
+	static const int BUDGET = 256;
+
+	int rt_cpu_;
+	int rt_priority_;
+	bool lock_memory_;
+	int epfd_;
+	int stop_fd_;
+	std::vector<capture*> caps_;
+
+	std::atomic<bool> running_;
+	std::atomic<uint64_t> wakeups_;
+	std::thread thread_;
+};
+
+}
+
+#endif
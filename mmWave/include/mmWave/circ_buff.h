@@ -0,0 +1,112 @@
+#ifndef MMWAVE_CIRC_BUFF_H
+#define MMWAVE_CIRC_BUFF_H
+
+#include <stdint.h>
+
+/*
+	C interface of libcbuffer (scripts/circ_buff.c).
+	The python ring_buffer loads the same functions through ctypes, keep the
+	signatures here in sync with the argtypes in scripts/circular_buffer.py.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// page size the ring memory of alloc_ring got
+enum {
+	RING_PAGES_NORMAL,
+	RING_PAGES_HUGETLB,
+	RING_PAGES_THP
+};
+
+int16_t* alloc_ring(int64_t len, int huge_pages, int* page_mode);
+
+void free_ring(int16_t* ring, int64_t len);
+
+int64_t find_pops(int64_t old_put_idx,
+			   int64_t new_put_idx,
+			   int64_t frame_size);
+
+void add_zeros(int64_t num_zeros,
+			   int16_t* buffer,
+			   int64_t buffer_len,
+			   int64_t* put_idx,
+			   int64_t frame_size,
+			   int64_t* pop_frame_idx);
+
+void add_msg(int16_t* msg,
+			 int64_t msg_len,
+			 int16_t* buffer,
+			 int64_t buffer_len,
+			 int64_t* put_idx,
+			 int64_t frame_size,
+			 int64_t* pop_frame_idx);
+
+void add_in_place(int64_t msg_len,
+			 int64_t buffer_len,
+			 int64_t* put_idx,
+			 int64_t frame_size,
+			 int64_t* pop_frame_idx);
+
+int64_t dca_byte_count(const uint8_t* header);
+
+int64_t dca_seqn(const uint8_t* header);
+
+void resync(int64_t bytec_n,
+			int16_t* buffer,
+			int64_t* put_idx,
+			int64_t frame_size);
+
+int needs_resync(int64_t bytec_c,
+			int64_t bytec_n,
+			int64_t frame_size);
+
+void pad_and_add_msg(int64_t bytec_c,
+			 int64_t bytec_n,
+			 int16_t* msg,
+			 int64_t msg_len,
+			 int16_t* buffer,
+			 int64_t buffer_len,
+			 int64_t* put_idx,
+			 int64_t frame_size,
+			 int64_t* pop_frame_idx);
+
+int64_t zeros_advance(int64_t num_zeros,
+			 int64_t put_idx,
+			 int64_t frame_size);
+
+// columns of the frame_infos rows filled by pad_and_add_msgs
+enum {
+	INFO_PACKETS,
+	INFO_LOST,
+	INFO_ZERO_FILLED,
+	INFO_FIRST_SEQ,
+	INFO_LAST_SEQ,
+	FRAME_INFO_LEN
+};
+
+void clear_frame_infos(int64_t* frame_infos, int64_t num_frames);
+
+int64_t pad_and_add_msgs(int64_t* bytec_c,
+			 int64_t* seqn_c,
+			 const uint8_t* headers,
+			 int64_t header_stride,
+			 int16_t* msgs,
+			 const int64_t* msg_lens,
+			 int64_t msg_stride,
+			 int64_t num_msgs,
+			 int64_t* num_added,
+			 int16_t* buffer,
+			 int64_t buffer_len,
+			 int64_t* put_idx,
+			 int64_t frame_size,
+			 int64_t* pop_frame_idxs,
+			 int64_t* frame_infos,
+			 int64_t* num_resyncs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef MMWAVE_DATA_FRAME_REF_H
+#define MMWAVE_DATA_FRAME_REF_H
+
+#include <mmWave/data_frame.h>
+#include <ros/message_traits.h>
+#include <ros/serialization.h>
+#include <std_msgs/Header.h>
+
+#include <stdint.h>
+#include <string.h>
+
+namespace mmwave
+{
+
+/*
+	A frame in the capture ring published as mmWave/data_frame without first
+	copying it into a data_frame message, roscpp serializes straight from the
+	ring into its send buffer. Only the ring -> wire copy is left.
+*/
+struct data_frame_ref
+{
+	std_msgs::Header header;
+	ros::Time first_stamp;
+	ros::Time last_stamp;
+	uint32_t packets_expected;
+	uint32_t packets_received;
+	uint32_t zero_filled;
+	uint32_t reordered;
+	uint32_t kernel_drops;
+	uint32_t first_seq;
+	uint32_t last_seq;
+	const int16_t* data;
+	int64_t len;
+};
+
+}
+
+namespace ros
+{
+namespace message_traits
+{
+
+template<> struct MD5Sum<mmwave::data_frame_ref>
+{
+	static const char* value() { return MD5Sum<mmWave::data_frame>::value(); }
+	static const char* value(const mmwave::data_frame_ref&) { return value(); }
+};
+
+template<> struct DataType<mmwave::data_frame_ref>
+{
+	static const char* value() { return DataType<mmWave::data_frame>::value(); }
+	static const char* value(const mmwave::data_frame_ref&) { return value(); }
+};
+
+template<> struct Definition<mmwave::data_frame_ref>
+{
+	static const char* value() { return Definition<mmWave::data_frame>::value(); }
+	static const char* value(const mmwave::data_frame_ref&) { return value(); }
+};
+
+template<> struct HasHeader<mmwave::data_frame_ref> : TrueType {};
+
+}
+
+namespace serialization
+{
+
+// same wire format as data_frame: header, first_stamp, last_stamp, the integrity
+// fields, uint32 length + int16[length]
+template<> struct Serializer<mmwave::data_frame_ref>
+{
+	template<typename Stream>
+	inline static void write(Stream& stream, const mmwave::data_frame_ref& m)
+	{
+		stream.next(m.header);
+		stream.next(m.first_stamp);
+		stream.next(m.last_stamp);
+		stream.next(m.packets_expected);
+		stream.next(m.packets_received);
+		stream.next(m.zero_filled);
+		stream.next(m.reordered);
+		stream.next(m.kernel_drops);
+		stream.next(m.first_seq);
+		stream.next(m.last_seq);
+		stream.next((uint32_t)m.len);
+		memcpy(stream.advance(m.len * sizeof(int16_t)), m.data, m.len * sizeof(int16_t));
+	}
+
+	inline static uint32_t serializedLength(const mmwave::data_frame_ref& m)
+	{
+		return serializationLength(m.header) + 8 + 8 + 7 * 4 + 4 + m.len * sizeof(int16_t);
+	}
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MMWAVE_DCA1000_H
+#define MMWAVE_DCA1000_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace mmwave
+{
+
+/*
+	Raw data packets sent by the DCA1000EVM on the data port.
+	Every datagram starts with a 10 byte little endian header:
+		uint32 sequence number (starts at 1)
+		uint48 byte count, number of ADC bytes sent before this packet
+	followed by up to 1456 bytes of ADC data (CONFIG_PACKET_DATA_CMD_CODE).
+	The packet size of that command counts 16 bytes more than the ADC data,
+	the default 1472 gives 1456.
+*/
+const uint16_t DCA_DATA_PORT = 4098;
+const uint16_t DCA_CMD_PORT = 4096;
+const size_t DCA_HEADER_LEN = 10;
+const size_t DCA_MAX_PAYLOAD = 1456;
+const size_t DCA_PACKET_OVERHEAD = 16;
+const size_t DCA_MAX_PACKET = 2048;
+
+struct dca_header
+{
+	uint32_t seqn;
+	uint64_t bytec;
+};
+
+inline dca_header parse_dca_header(const uint8_t* p)
+{
+	dca_header h;
+	h.seqn = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+	h.bytec = 0;
+	for (int i = 5; i >= 0; --i)
+		h.bytec = (h.bytec << 8) | p[4 + i];
+	return h;
+}
+
+inline void write_dca_header(uint8_t* p, uint32_t seqn, uint64_t bytec)
+{
+	for (int i = 0; i < 4; ++i)
+		p[i] = (uint8_t)(seqn >> (8 * i));
+	for (int i = 0; i < 6; ++i)
+		p[4 + i] = (uint8_t)(bytec >> (8 * i));
+}
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef MMWAVE_DCA1000_CONTROL_H
+#define MMWAVE_DCA1000_CONTROL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+namespace mmwave
+{
+
+/*
+	Command port protocol of the DCA1000EVM (UDP 4096), all little endian:
+		command  uint16 0xa55a, uint16 code, uint16 data size, data, uint16 0xeeaa
+		response uint16 0xa55a, uint16 code, uint16 status, uint16 0xeeaa
+	status is 0 for success, except for READ_FPGA_VERSION where it is the
+	version. The board also sends SYSTEM_ERROR responses on its own; some
+	boards acknowledge RECORD_START only with a SYSTEM_ERROR of status
+	DCA_RECORD_STARTED (5a a5 0a 00 01 00 aa ee).
+*/
+const uint16_t DCA_CMD_HEADER = 0xa55a;
+const uint16_t DCA_CMD_FOOTER = 0xeeaa;
+const uint16_t DCA_RECORD_STARTED = 1;
+// the most 16 bits of 8 ns ticks hold
+const uint32_t DCA_MAX_PACKET_DELAY_US = 0xffff * 8 / 1000;
+const size_t DCA_RESPONSE_LEN = 8;
+
+enum dca_cmd_code
+{
+	DCA_RESET_FPGA = 0x01,
+	DCA_RESET_AR_DEV = 0x02,
+	DCA_CONFIG_FPGA_GEN = 0x03,
+	DCA_CONFIG_EEPROM = 0x04,
+	DCA_RECORD_START = 0x05,
+	DCA_RECORD_STOP = 0x06,
+	DCA_PLAYBACK_START = 0x07,
+	DCA_PLAYBACK_STOP = 0x08,
+	DCA_SYSTEM_CONNECT = 0x09,
+	DCA_SYSTEM_ERROR = 0x0a,
+	DCA_CONFIG_PACKET_DATA = 0x0b,
+	DCA_CONFIG_DATA_MODE_AR_DEV = 0x0c,
+	DCA_INIT_FPGA_PLAYBACK = 0x0d,
+	DCA_READ_FPGA_VERSION = 0x0e,
+};
+
+enum dca_lvds_mode { DCA_LVDS_4_LANES = 1, DCA_LVDS_2_LANES = 2 };
+enum dca_data_format { DCA_FORMAT_12_BIT = 1, DCA_FORMAT_14_BIT = 2, DCA_FORMAT_16_BIT = 3 };
+
+// CONFIG_FPGA_GEN, the defaults are raw ethernet streaming of 16 bit samples on 4 lanes
+struct dca_fpga_config
+{
+	uint8_t logging_mode;		// 1 raw, 2 multi
+	dca_lvds_mode lvds_mode;
+	uint8_t transfer_mode;		// 1 LVDS capture, 2 playback
+	uint8_t capture_mode;		// 1 SD card, 2 ethernet stream
+	dca_data_format data_format;
+	uint8_t timer_s;			// record timeout
+
+	dca_fpga_config()
+		: logging_mode(1), lvds_mode(DCA_LVDS_4_LANES), transfer_mode(1), capture_mode(2),
+		  data_format(DCA_FORMAT_16_BIT), timer_s(30) {}
+};
+
+// CONFIG_PACKET_DATA
+struct dca_packet_config
+{
+	uint16_t packet_size;	// bytes of a data port datagram
+	uint32_t delay_us;		// between datagrams, sent as 8 ns FPGA clock ticks, at most DCA_MAX_PACKET_DELAY_US
+
+	dca_packet_config() : packet_size(1472), delay_us(20) {}
+};
+
+// the command datagram, 8 + data.size() bytes
+std::vector<uint8_t> dca_build_cmd(uint16_t code, const std::vector<uint8_t>& data = std::vector<uint8_t>());
+// false if p is not a response
+bool dca_parse_response(const uint8_t* p, size_t len, uint16_t& code, uint16_t& status);
+// the board side, see dca1000_emulator
+std::vector<uint8_t> dca_build_response(uint16_t code, uint16_t status);
+// false if p is not a command, data points into p
+bool dca_parse_cmd(const uint8_t* p, size_t len, uint16_t& code, const uint8_t*& data, size_t& data_len);
+
+/*
+	Client for the command port. Commands are built from typed parameters,
+	a batch is sent back to back and the responses are matched by command
+	code, so a bring-up costs one round trip rather than one per command.
+	Every command has a deadline; unanswered commands are resent up to
+	retries times, then the batch fails with the reason in error(). With
+	the defaults a board that does not answer is reported in 400 ms.
+*/
+class dca1000_control
+{
+public:
+	dca1000_control();
+	~dca1000_control();
+
+	// binds host_addr:4096 and talks to dca_addr:4096
+	bool open(const std::string& host_addr, const std::string& dca_addr);
+	void close();
+	void set_timing(int deadline_ms, int retries);
+
+	// SYSTEM_CONNECT, READ_FPGA_VERSION, CONFIG_FPGA_GEN and CONFIG_PACKET_DATA in one batch
+	bool setup(const dca_fpga_config& fpga, const dca_packet_config& packet);
+	// a SYSTEM_ERROR of status DCA_RECORD_STARTED acknowledges it as well
+	bool record_start();
+	bool record_stop();
+	bool reset_fpga();
+	bool reset_ar_dev();
+
+	uint16_t fpga_version() const { return fpga_version_; }
+	// SYSTEM_ERROR statuses the board sent on its own, each fails the batch it came in
+	uint64_t system_errors() const { return system_errors_; }
+	uint16_t last_system_error() const { return last_system_error_; }
+	const std::string& error() const { return error_; }
+
+private:
+	struct command
+	{
+		uint16_t code;
+		std::vector<uint8_t> datagram;
+		int sent;
+		bool answered;
+		uint16_t status;
+	};
+
+	static command make(uint16_t code, const std::vector<uint8_t>& data = std::vector<uint8_t>());
+	bool send(command& c);
+	bool run(std::vector<command>& cmds);
+	void fail_pending(uint16_t status, const std::vector<command>& cmds);
+	bool check(const command& c);
+
+	int fd_;
+	sockaddr_in dca_addr_;
+	int deadline_ms_;
+	int retries_;
+	uint16_t fpga_version_;
+	uint64_t system_errors_;
+	uint16_t last_system_error_;
+	std::string error_;
+};
+
+}
+
+extern "C" {
+#endif
+
+/*
+	C interface for ctypes (mmWave_class_noQt.py). Every call but dca_open
+	returns 1 on success and 0 on failure, dca_error tells why.
+*/
+void* dca_open(const char* host_addr, const char* dca_addr, int deadline_ms, int retries);
+void dca_close(void* dca);
+int dca_setup(void* dca, int lvds_lanes, int packet_size, int packet_delay_us);
+int dca_record_start(void* dca);
+int dca_record_stop(void* dca);
+int dca_fpga_version(void* dca);
+const char* dca_error(void* dca);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef MMWAVE_DCA1000_EMULATOR_H
+#define MMWAVE_DCA1000_EMULATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+namespace mmwave
+{
+
+// faults injected into the data stream, probabilities per packet
+struct dca_impairments
+{
+	double loss;		// the packet is not sent, its sequence number and bytes are skipped
+	double reorder;		// the packet is swapped with the next one of the frame
+	double duplicate;	// the packet is sent twice
+	unsigned seed;
+
+	dca_impairments() : loss(0), reorder(0), duplicate(0), seed(1) {}
+};
+
+/*
+	Sends frames the way the DCA1000 does on its data port: the ADC bytes are
+	one stream cut into datagrams of payload bytes behind the 10 byte
+	seqn/bytec header (dca1000.h). Packets do not care about frames, the one
+	at the end of a frame carries the head of the next; the bytes that do
+	not fill it wait for the next frame. Only finish, at the end of a
+	recording, sends them as a short datagram.
+
+	With a packet delay the datagrams of a frame are spaced by a busy wait,
+	like the FPGA inter packet delay, otherwise a frame goes out in
+	sendmmsg batches.
+*/
+class dca_streamer
+{
+public:
+	typedef std::chrono::steady_clock clock_type;
+
+	// fd is a UDP socket connected to the capture host
+	dca_streamer(int fd, const dca_impairments& impairments);
+
+	void set_payload(size_t payload) { payload_ = payload; }
+	void set_packet_delay_ns(int64_t ns) { delay_ns_ = ns; }
+	// a new stream, seqn starts at 1 and the byte count at 0
+	void restart();
+	bool send_frame(const uint8_t* data, size_t len);
+	// the end of the stream, the bytes short of a full packet go out
+	bool finish() { return send(NULL, 0, true); }
+
+	uint64_t packets() const { return packets_; }	// datagrams sent, duplicates included
+	uint64_t bytes() const { return bytec_ + tail_.size(); }	// ADC bytes of the stream
+	uint64_t lost() const { return lost_; }
+	uint64_t reordered() const { return reordered_; }
+	uint64_t duplicated() const { return duplicated_; }
+
+private:
+	bool chance(double p) { return p > 0 && uniform_(rng_) < p; }
+	// the held tail and data as packets, with end the last one may be short
+	bool send(const uint8_t* data, size_t len, bool end);
+	// queues packet k of the batch, unless it is lost
+	void emit(size_t k);
+	bool flush(size_t count);
+
+	static const size_t BATCH = 64;
+
+	int fd_;
+	dca_impairments impairments_;
+	size_t payload_;
+	int64_t delay_ns_;
+	uint32_t seqn_;
+	uint64_t bytec_;			// of the next packet
+	std::vector<uint8_t> tail_;	// stream bytes after it, less than a packet
+
+	std::mt19937 rng_;
+	std::uniform_real_distribution<double> uniform_;
+
+	std::vector<uint8_t> headers_;
+	std::vector<size_t> order_;
+	std::vector<iovec> iov_;
+	std::vector<mmsghdr> msgs_;
+
+	uint64_t packets_;
+	uint64_t lost_;
+	uint64_t reordered_;
+	uint64_t duplicated_;
+};
+
+struct emulator_config
+{
+	std::string addr;			// board address, the control and data ports are bound here
+	std::string data_host;		// empty for the host that sent RECORD_START
+	uint16_t data_port;
+	size_t frame_bytes;			// 4 * adcSamples * numLanes * numChirps
+	double frame_rate;			// frames per second, 0 for as fast as the socket takes them
+	uint64_t frames;			// frames per recording, 0 until RECORD_STOP
+	std::string file;			// bare ADC data the frames are replayed from, synthetic if empty
+	int64_t packet_delay_ns;	// -1 for the delay set by CONFIG_PACKET_DATA
+	uint16_t fpga_version;
+	dca_impairments impairments;
+
+	emulator_config()
+		: addr("127.0.0.2"), data_port(4098), frame_bytes(0), frame_rate(10), frames(0),
+		  packet_delay_ns(-1), fpga_version(898) {}
+};
+
+/*
+	A DCA1000EVM without the hardware, for benchmarks and regression tests of
+	the capture path on any Linux box.
+
+	The command port answers the protocol of dca1000_control (and of the
+	older python client): SYSTEM_CONNECT, READ_FPGA_VERSION, CONFIG_FPGA_GEN,
+	CONFIG_PACKET_DATA, RECORD_START and RECORD_STOP, the reset and the
+	other commands are acknowledged and ignored. The packet size and delay
+	of CONFIG_PACKET_DATA are used for the stream.
+
+	Between RECORD_START and RECORD_STOP frames are sent at frame_rate to
+	data_host:data_port. Synthetic frames count: int16 word k of frame f is
+	f + k, so a receiver can check them. With file set the frames are cut
+	from the file and it loops. The file is bare ADC data (adc_data.bin after
+	Packet_Reorder_Zerofill, a RECORDING_FRAMES file), a raw capture with
+	packet headers (adc_data_Raw_0.bin) is sent with dca_replay instead.
+*/
+class dca1000_emulator
+{
+public:
+	explicit dca1000_emulator(const emulator_config& cfg);
+	~dca1000_emulator();
+
+	bool open();
+	// serves commands and streams until stop(), from any thread
+	void run();
+	void stop() { running_ = false; }
+
+	const dca_streamer& streamer() const { return *streamer_; }
+	uint64_t frames() const { return frames_; }
+	bool recording() const { return recording_; }
+	const std::string& error() const { return error_; }
+
+private:
+	void handle_commands();
+	void handle(uint16_t code, const uint8_t* data, size_t len, const sockaddr_in& from, uint16_t& status);
+	bool start_recording(const sockaddr_in& from);
+	void send_frame();
+	void print_stats() const;
+
+	emulator_config cfg_;
+	int cmd_fd_;
+	int data_fd_;
+	std::unique_ptr<dca_streamer> streamer_;
+	std::vector<uint8_t> file_;
+	std::vector<uint8_t> frame_;
+
+	std::atomic<bool> running_;
+	std::atomic<bool> recording_;
+	std::atomic<uint64_t> frames_;
+	uint64_t recording_frames_;
+	dca_streamer::clock_type::time_point next_frame_;
+	std::string error_;
+};
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef MMWAVE_DCA_REPLAY_H
+#define MMWAVE_DCA_REPLAY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+namespace mmwave
+{
+
+enum recording_format
+{
+	RECORDING_RAW,		// DCA1000 packets with their header, adc_data_Raw_0.bin of mmWave Studio / DCA1000 CLI
+	RECORDING_FRAMES,	// the bare ADC stream, adc_data.bin after Packet_Reorder_Zerofill or dca1000_emulator -f files
+};
+
+/*
+	A capture file as the list of datagrams the board sent.
+
+	A raw file holds every packet as its 10 byte header and payload bytes of
+	ADC data, the last one of a file may be shorter. The packets keep their
+	recorded sequence numbers and byte counts, so the loss and reordering of
+	the recording are replayed as well. A frames file is cut into payload
+	sized packets numbered from 1 like dca_streamer does.
+
+	Several files (adc_data_Raw_0.bin, adc_data_Raw_1.bin, ...) are one
+	recording when loaded in order.
+*/
+class dca_recording
+{
+public:
+	struct packet
+	{
+		uint32_t seqn;
+		uint64_t bytec;
+		size_t offset;	// of the payload in data()
+		size_t len;
+	};
+
+	dca_recording() : payload_(0) {}
+
+	bool load(const std::vector<std::string>& files, recording_format format, size_t payload);
+
+	const std::vector<packet>& packets() const { return packets_; }
+	const uint8_t* data() const { return data_.empty() ? NULL : &data_[0]; }
+	// ADC bytes from the first packet to the end of the last one
+	uint64_t stream_bytes() const;
+	const std::string& error() const { return error_; }
+
+private:
+	bool load_raw(const std::vector<uint8_t>& file);
+
+	size_t payload_;
+	std::vector<uint8_t> data_;
+	std::vector<packet> packets_;
+	std::string error_;
+};
+
+struct replay_config
+{
+	std::string dest;			// capture host
+	uint16_t port;
+	size_t frame_bytes;			// 4 * adcSamples * numLanes * numChirps, places the packets in frames
+	double frame_rate;			// of the recording, 0 for flat out
+	double speed;				// 2 replays twice as fast
+	int64_t packet_delay_ns;	// between the packets of a frame at speed 1, the board default is 20 us
+	bool txtime;				// hand the send times to the qdisc (SO_TXTIME) instead of busy waiting
+	bool txtime_tai;			// send times on CLOCK_TAI, for the etf qdisc
+	int loops;					// 0 until stop()
+
+	replay_config()
+		: dest("127.0.0.1"), port(4098), frame_bytes(0), frame_rate(10), speed(1),
+		  packet_delay_ns(20000), txtime(false), txtime_tai(false), loops(1) {}
+};
+
+/*
+	Sends a dca_recording to a capture node on the schedule of the board:
+	frame k of the stream starts k / frame_rate after the first one, and the
+	packets of a frame follow each other packet_delay_ns apart, all divided
+	by speed. Loops continue the sequence numbers and byte counts, the
+	capture sees one long stream.
+
+	The default pacing sleeps until shortly before a packet is due and
+	busy waits the rest on CLOCK_MONOTONIC, which holds the schedule to a
+	few microseconds on an idle core. With txtime each packet carries its
+	send time (SCM_TXTIME) and is handed over ahead of it, the qdisc of the
+	interface releases it. fq (tc qdisc add dev eth0 root fq) takes the
+	CLOCK_MONOTONIC times of the schedule. etf drops every packet whose
+	clock is not CLOCK_TAI, with txtime_tai the times are moved to it.
+	Without such a qdisc the time is ignored and the packets leave at once.
+
+	The lateness counters tell how far behind the schedule the packets were
+	handed to the kernel, the figure to check before trusting a benchmark.
+*/
+class dca_replayer
+{
+public:
+	dca_replayer(const dca_recording& rec, const replay_config& cfg);
+	~dca_replayer();
+
+	bool open();
+	bool run();
+	void stop() { running_ = false; }
+
+	uint64_t packets() const { return packets_; }
+	uint64_t frames() const { return frames_; }
+	uint64_t bytes() const { return bytes_; }	// ADC bytes sent
+	uint64_t max_lateness_ns() const { return max_lateness_ns_; }
+	uint64_t mean_lateness_ns() const { return paced_ ? lateness_ns_ / paced_ : 0; }
+	uint64_t elapsed_ns() const { return elapsed_ns_; }
+	const std::string& error() const { return error_; }
+
+private:
+	bool send(const dca_recording::packet& p, uint32_t seqn, uint64_t bytec, uint64_t due);
+	bool flush();
+	void wait_until(uint64_t due);
+
+	static const size_t BATCH = 64;
+	// sleep until this long before a packet is due, busy wait the rest
+	static const int64_t SPIN_NS = 200000;
+	// how far ahead of its time a packet is handed to the qdisc with txtime
+	static const int64_t TXTIME_LEAD_NS = 1000000;
+
+	const dca_recording& rec_;
+	replay_config cfg_;
+	int fd_;
+
+	std::vector<uint8_t> headers_;
+	std::vector<iovec> iov_;
+	std::vector<mmsghdr> msgs_;
+	std::vector<uint8_t> control_;
+	size_t queued_;
+	size_t batch_;
+	int64_t txtime_offset_;	// added to the schedule for the SCM_TXTIME clock
+
+	std::atomic<bool> running_;
+	uint64_t packets_;
+	uint64_t frames_;
+	uint64_t bytes_;
+	uint64_t paced_;
+	uint64_t lateness_ns_;
+	uint64_t max_lateness_ns_;
+	uint64_t elapsed_ns_;
+	std::string error_;
+};
+
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef MMWAVE_FRAME_ASSEMBLER_H
+#define MMWAVE_FRAME_ASSEMBLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+#include "mmWave/frame_pool.h"
+#include "mmWave/frame_queue.h"
+
+namespace mmwave
+{
+
+// what happens to a completed frame when the consumer holds every slot
+enum overrun_policy
+{
+	OVERRUN_DROP_NEWEST,	// it is dropped
+	OVERRUN_DROP_OLDEST,	// the oldest queued frame the consumer has not taken is reused for it
+	OVERRUN_BLOCK,			// the producer waits up to a deadline for a slot, then drops it
+};
+
+/*
+	Cuts the ADC sample stream into frames held in frame_pool slots, the slot
+	based counterpart of add_msg/add_zeros in circ_buff.c.
+
+	Packets are placed by their absolute position in the stream (byte count / 2).
+	A gap is zero filled and remembered as a hole; whole frames of zeros are
+	skipped like in circ_buff.c. A completed frame is held back until the stream
+	is reorder_window samples past its end, a late packet that falls in a hole
+	of a held frame is written at its offset. Packets from before that, or that
+	do not fall in a hole (duplicates), are dropped. At the end of a stream
+	nothing moves the window past the last frames, flush hands them out.
+
+	Frame boundaries are taken from the stream position modulo the frame
+	length. The first packet, and a packet more than a frame and the window
+	behind (restarted byte counter), resync the assembler: the frame in
+	progress is dropped and the packet starts a new one at its offset, the
+	head of that frame is zero filled.
+
+	The producer always holds the slot being filled (cur) and the one after it
+	(next) so a packet crossing a frame boundary, or a scatter read aimed at
+	the ring, can be split between the two. Released slots are pushed to the
+	frame queue. If no slot is free the overrun policy decides: drop newest
+	sends the samples to a private scratch frame that is dropped once
+	complete, drop oldest takes the oldest frame back out of the queue, block
+	sleeps until the consumer releases a slot or the deadline passes. After a
+	timed out wait the assembler drops newest until a slot is free again, a
+	stalled consumer costs one deadline and not one per frame. Slots
+	referenced by the consumer are never written.
+*/
+class frame_assembler
+{
+public:
+	frame_assembler(frame_pool& pool, frame_queue& queue, int64_t reorder_window,
+					overrun_policy overrun = OVERRUN_DROP_NEWEST, int block_ms = 0);
+	~frame_assembler();
+
+	// packet seqn with len samples that start at sample pos of the stream,
+	// received at stamp (ns, 0 if unknown), false if it was dropped as stale
+	bool add_msg(uint32_t seqn, uint64_t pos, const int16_t* msg, int64_t len, uint64_t stamp);
+	// len samples were already written at the fill position (see target)
+	void add_in_place(uint32_t seqn, int64_t len, uint64_t stamp);
+
+	// where the sample offset samples past the fill position goes and how many
+	// samples fit contiguously there, offset must be below room()
+	int16_t* target(int64_t offset, int64_t& contiguous);
+	int64_t room() const { return 2 * frame_len_ - fill_; }
+
+	// stream position of the next expected sample
+	uint64_t position() const { return pos_; }
+
+	// hands out the frames held for late packets at once, for when the stream
+	// stopped (receive timeout, end of capture) and no late packet will come
+	void flush();
+	size_t held_frames() const { return pending_count_; }
+
+	uint64_t frames() const { return frames_; }
+	uint64_t dropped_frames() const { return dropped_frames_; }	// for any policy
+	uint64_t overwritten_frames() const { return overwritten_frames_; }	// of those, taken back from the queue
+	uint64_t blocked() const { return blocked_; }				// waits for a slot
+	uint64_t block_timeouts() const { return block_timeouts_; }	// waits that gave up
+	uint64_t blocked_ns() const { return blocked_ns_; }			// total time waited
+	uint64_t zero_filled() const { return zero_filled_; }
+	uint64_t reordered() const { return reordered_; }
+	uint64_t stale_packets() const { return stale_packets_; }
+	uint64_t resyncs() const { return resyncs_; }
+
+	// lost packets are blamed on the host kernel as long as its drop counter
+	// (total since the socket was opened) is ahead of what was blamed so far,
+	// the rest was lost on the wire or by the board
+	void set_kernel_drops(uint64_t total) { kernel_drops_ = total; }
+	uint64_t kernel_drops() const { return kernel_drops_; }
+	uint64_t lost_packets() const { return lost_packets_; }
+	uint64_t kernel_lost() const { return kernel_lost_; }
+	uint64_t wire_lost() const { return lost_packets_ - kernel_lost_; }
+
+private:
+	// zero filled range of the stream and the sequence numbers missing in it
+	struct hole
+	{
+		uint64_t start;
+		uint64_t end;
+		uint32_t seq_lo;
+		uint32_t seq_hi;
+	};
+
+	// completed frame waiting for late packets
+	struct pending
+	{
+		int64_t slot;
+		uint64_t base;
+	};
+
+	void resync(uint64_t pos);
+	void write(const int16_t* msg, int64_t len, uint64_t stamp);
+	void count_packet(int64_t slot, uint32_t seqn);
+	void add_stamp(int64_t slot, uint64_t stamp);
+	void add_zeros(int64_t num_zeros, uint32_t seqn);
+	bool add_late(uint32_t seqn, uint64_t pos, const int16_t* msg, int64_t len, uint64_t stamp);
+	int16_t* held_frame(uint64_t pos, int64_t& slot, uint64_t& base);
+	void complete();
+	void release_ready();
+	void release(const pending& p);
+	void finalize_holes(uint64_t base, uint64_t end, frame_info* info);
+	int16_t* data_for(int64_t slot, const int16_t* other);
+	int64_t acquire();
+	int64_t wait_for_slot();
+
+	frame_pool& pool_;
+	frame_queue& queue_;
+	int64_t frame_len_;
+	int64_t window_;	// samples
+	overrun_policy overrun_;
+	int64_t block_ns_;
+	bool timed_out_;	// last wait for a slot gave up, do not wait again before one is free
+
+	int64_t cur_;		// slot being filled, -1 for scratch
+	int64_t next_;
+	int16_t* cur_data_;
+	int16_t* next_data_;
+	int64_t fill_;		// samples already in cur
+	uint64_t pos_;
+	uint32_t seqn_;		// last sequence number added in order
+	bool synced_;		// pos_ follows the byte counter
+	std::vector<int16_t> scratch_;	// two frames for when cur and next are both scratch
+
+	std::vector<pending> pending_;	// fifo, pending_head_ is the oldest
+	size_t pending_head_;
+	size_t pending_count_;
+	std::vector<hole> holes_;		// sorted by start
+	size_t num_holes_;
+
+	std::atomic<uint64_t> frames_;
+	std::atomic<uint64_t> dropped_frames_;
+	std::atomic<uint64_t> overwritten_frames_;
+	std::atomic<uint64_t> blocked_;
+	std::atomic<uint64_t> block_timeouts_;
+	std::atomic<uint64_t> blocked_ns_;
+	std::atomic<uint64_t> zero_filled_;
+	std::atomic<uint64_t> reordered_;
+	std::atomic<uint64_t> stale_packets_;
+	std::atomic<uint64_t> resyncs_;
+	std::atomic<uint64_t> kernel_drops_;
+	std::atomic<uint64_t> lost_packets_;
+	std::atomic<uint64_t> kernel_lost_;
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MMWAVE_FRAME_CLOCK_H
+#define MMWAVE_FRAME_CLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+namespace mmwave
+{
+
+/*
+	Online model of the radar frame clock in host time. The radar starts a
+	frame every frameCfg period, so the receive time of frame k is a line
+	t = t0 + period * k plus host side latency that jitters with interrupt
+	coalescing and scheduling.
+
+	The line is fitted by least squares over the last window frames. Frames
+	further than 3 sigma (from the median absolute deviation) off the last
+	model, or off a first fit of all frames before it is locked, are rejected
+	as outliers and the line is fitted again without them. The de-jittered
+	time of a frame is the fit evaluated at its index.
+
+	The stream index going backwards (byte counter restart) or a run of
+	outliers (the radar was restarted) starts a new model. Until min_frames
+	are in it the raw times are passed through.
+
+	update is called by one thread, the estimates can be read from any.
+*/
+class frame_clock
+{
+public:
+	// nominal_period in ns from the radar config, 0 if unknown, window of at
+	// least MIN_FRAMES
+	explicit frame_clock(double nominal_period, size_t window = 256);
+
+	// frame index of the stream received at stamp (ns), returns its de-jittered
+	// time in ns, stamp itself until the model is locked, 0 if both are unknown
+	uint64_t update(uint64_t index, uint64_t stamp);
+	void reset();
+
+	bool locked() const { return locked_.load(std::memory_order_relaxed); }
+	double period() const { return period_.load(std::memory_order_relaxed); }	// fitted, ns
+	// radar clock against host clock in ppm, positive when radar frames are
+	// longer than nominal in host time
+	double drift_ppm() const { return drift_ppm_.load(std::memory_order_relaxed); }
+	double jitter() const { return jitter_.load(std::memory_order_relaxed); }	// rms residual of the inliers, ns
+	uint64_t outliers() const { return outliers_.load(std::memory_order_relaxed); }
+	uint64_t resets() const { return resets_.load(std::memory_order_relaxed); }
+
+	static const size_t MIN_FRAMES = 8;
+	static const int MAX_OUTLIER_RUN = 8;
+
+private:
+	struct sample
+	{
+		uint64_t index;
+		uint64_t stamp;
+		bool inlier;
+	};
+
+	void add(uint64_t index, uint64_t stamp);
+	bool fit(bool inliers_only, double& offset, double& slope) const;
+	void reject(double offset, double slope);
+	double residual(const sample& s, double offset, double slope) const;
+	uint64_t at(uint64_t index) const;
+
+	double nominal_;
+	std::vector<sample> samples_;	// ring of the last window frames
+	size_t head_;					// oldest
+	size_t count_;
+	int outlier_run_;
+	uint64_t ref_index_;			// fit origin, the oldest sample
+	uint64_t ref_stamp_;
+	double offset_;					// last fit, ns from ref_stamp_
+	double slope_;					// ns per frame
+	std::vector<double> scratch_;	// residuals for the median
+
+	std::atomic<bool> locked_;
+	std::atomic<double> period_;
+	std::atomic<double> drift_ppm_;
+	std::atomic<double> jitter_;
+	std::atomic<uint64_t> outliers_;
+	std::atomic<uint64_t> resets_;
+};
+
+}
+
+#endif
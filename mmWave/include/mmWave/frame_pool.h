@@ -0,0 +1,72 @@
+#ifndef MMWAVE_FRAME_POOL_H
+#define MMWAVE_FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace mmwave
+{
+
+// integrity of a frame, written by the producer before the frame is queued
+struct frame_info
+{
+	uint64_t index;			// frame number in the stream, byte count / 2 / frame_len
+	uint32_t packets;		// received, counted in the frame holding their first sample
+	uint32_t first_seq;		// of the packets received
+	uint32_t last_seq;
+	uint32_t reordered;		// late packets written at their offset
+	uint32_t lost_packets;	// packets that never arrived
+	uint32_t kernel_drops;	// of those, dropped by the host kernel
+	uint64_t zero_filled;	// samples left zero
+	uint64_t first_stamp;	// kernel receive time of the earliest packet, ns, 0 if none
+	uint64_t last_stamp;	// and of the latest
+};
+
+/*
+	Fixed set of preallocated frame slots with a reference count each.
+	The producer acquires a free slot, fills it and hands its reference on
+	with the slot index; whoever holds the last reference releases it. A slot
+	is only reused once its count is back to zero, so a frame still being
+	read is never overwritten. Nothing is allocated after construction.
+
+	The slots are one alloc_ring block (circ_buff.h), on 2 MB pages when
+	huge_pages is set and the host has them, page_mode tells which.
+*/
+class frame_pool
+{
+public:
+	frame_pool(int64_t frame_len, int64_t num_slots, bool huge_pages = false);
+	~frame_pool();
+
+	// producer side, returns a slot with one reference or -1 if all are in use
+	int64_t acquire();
+
+	void retain(int64_t slot);
+	void release(int64_t slot);
+
+	int16_t* data(int64_t slot) { return &data_[slot * frame_len_]; }
+	frame_info& info(int64_t slot) { return info_[slot]; }
+	const frame_info& info(int64_t slot) const { return info_[slot]; }
+	const int16_t* data(int64_t slot) const { return &data_[slot * frame_len_]; }
+
+	int64_t frame_len() const { return frame_len_; }
+	int64_t num_slots() const { return num_slots_; }
+	int64_t in_use() const;
+	int page_mode() const { return page_mode_; }	// RING_PAGES_*
+
+private:
+	int64_t frame_len_;
+	int64_t num_slots_;
+	int16_t* data_;
+	int page_mode_;
+	std::vector<frame_info> info_;
+	std::unique_ptr<std::atomic<int>[]> refs_;
+	int64_t cursor_;	// producer only, next slot to try
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MMWAVE_FRAME_QUEUE_H
+#define MMWAVE_FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+namespace mmwave
+{
+
+/*
+	Bounded single producer / single consumer queue of frame slot indices.
+	push and try_pop are lock free, pop blocks on an eventfd so an idle
+	consumer sleeps in the kernel instead of polling. The producer only
+	signals the eventfd when the consumer announced it is about to sleep.
+
+	The producer may also take back the oldest entry with steal, the tail is
+	then moved with a compare and swap on both sides. A consumer that lost
+	the swap may have read an entry the producer was already writing again,
+	the entries are atomics so that read is only discarded.
+*/
+class frame_queue
+{
+public:
+	explicit frame_queue(size_t capacity);
+	~frame_queue();
+
+	// producer side, false if the queue is full
+	bool push(int64_t slot);
+	// producer side, the oldest slot the consumer has not popped yet
+	bool steal(int64_t& slot);
+
+	// consumer side
+	bool try_pop(int64_t& slot);
+	bool pop(int64_t& slot, int timeout_ms);
+	void wake();
+
+	size_t capacity() const { return mask_ + 1; }
+	size_t depth() const;
+	size_t high_water() const { return high_water_.load(std::memory_order_relaxed); }
+	int fd() const { return efd_; }
+
+private:
+	void signal();
+
+	std::vector<std::atomic<int64_t> > slots_;
+	size_t mask_;
+	int efd_;
+
+	// producer and consumer indices on their own cache lines
+	alignas(64) std::atomic<size_t> head_;
+	alignas(64) std::atomic<size_t> tail_;
+	alignas(64) std::atomic<bool> sleeping_;
+	std::atomic<size_t> high_water_;
+};
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef MMWAVE_FRAME_VIEW_H
+#define MMWAVE_FRAME_VIEW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <complex>
+#include <stdexcept>
+#include <type_traits>
+
+namespace mmwave
+{
+
+/*
+	Typed read only views of the int16 words of a captured frame.
+
+	The ring and the DCA1000 byte counter stay in int16 words, a view only
+	gives them a layout: a frame is chirps records, a record is an optional
+	chirp parameter block (setProfileCfg CP_ADC puts it before the samples,
+	ADC_CP after them) and samples samples of type Sample. The sample types
+	below describe what the LVDS lanes carry for one ADC sample, their size
+	and alignment are checked at compile time, the frame length against the
+	layout when a view is made.
+*/
+
+// one complex sample of every lane, the I words of all lanes then the Q words (xWR14xx, adcCfg 2 1/2)
+template <int Lanes>
+struct complex_lanes
+{
+	static const int LANES = Lanes;
+	static const size_t WORDS = 2 * Lanes;
+
+	int16_t i[Lanes];
+	int16_t q[Lanes];
+
+	std::complex<float> rx(int lane) const { return std::complex<float>(i[lane], q[lane]); }
+};
+
+// one real sample of every lane
+template <int Lanes>
+struct real_lanes
+{
+	static const int LANES = Lanes;
+	static const size_t WORDS = Lanes;
+
+	int16_t v[Lanes];
+
+	float rx(int lane) const { return v[lane]; }
+};
+
+// where setProfileCfg puts the chirp parameters of a chirp
+enum cp_position
+{
+	CP_NONE,	// ADC
+	CP_BEFORE,	// CP_ADC
+	CP_AFTER,	// ADC_CP
+};
+
+template <class Sample, cp_position Pos = CP_NONE, size_t CpWords = 0>
+struct chirp_layout
+{
+	static_assert(Sample::LANES > 0, "a sample needs at least one lane");
+	static_assert(sizeof(Sample) == Sample::WORDS * sizeof(int16_t), "samples must not be padded");
+	static_assert(alignof(Sample) <= alignof(int16_t), "samples must fit any int16 offset of the ring");
+	static_assert((Pos == CP_NONE) == (CpWords == 0), "chirp parameters need a position and a size");
+
+	typedef Sample sample_type;
+	static const cp_position CP_POS = Pos;
+	static const size_t CP_WORDS = CpWords;
+
+	// words of a chirp record with samples samples
+	static size_t record_words(size_t samples) { return CpWords + samples * Sample::WORDS; }
+	// offset of the first sample in the record
+	static size_t samples_offset() { return Pos == CP_BEFORE ? CpWords : 0; }
+	static size_t cp_offset(size_t samples) { return Pos == CP_BEFORE ? 0 : samples * Sample::WORDS; }
+};
+
+template <class Layout>
+class frame_view
+{
+public:
+	typedef typename Layout::sample_type sample_type;
+
+	// true if len words are exactly chirps records of samples samples
+	static bool fits(int64_t len, size_t chirps, size_t samples)
+	{
+		return len >= 0 && (uint64_t)len == chirps * Layout::record_words(samples);
+	}
+
+	// throws std::length_error unless fits(len, chirps, samples)
+	frame_view(const int16_t* data, int64_t len, size_t chirps, size_t samples)
+		: data_(data), chirps_(chirps), samples_(samples), record_(Layout::record_words(samples))
+	{
+		if (!fits(len, chirps, samples))
+			throw std::length_error("frame length does not match the chirp layout");
+	}
+
+	size_t chirps() const { return chirps_; }
+	size_t samples() const { return samples_; }
+	static int lanes() { return sample_type::LANES; }
+
+	// samples of chirp c
+	const sample_type* chirp(size_t c) const
+	{
+		return reinterpret_cast<const sample_type*>(data_ + c * record_ + Layout::samples_offset());
+	}
+	const sample_type& at(size_t c, size_t s) const { return chirp(c)[s]; }
+
+	// Layout::CP_WORDS chirp parameter words of chirp c, NULL without them
+	const int16_t* cp(size_t c) const
+	{
+		return Layout::CP_WORDS ? data_ + c * record_ + Layout::cp_offset(samples_) : NULL;
+	}
+
+	const int16_t* data() const { return data_; }
+
+private:
+	const int16_t* data_;
+	size_t chirps_;
+	size_t samples_;
+	size_t record_;
+};
+
+template <int Lanes> const int complex_lanes<Lanes>::LANES;
+template <int Lanes> const size_t complex_lanes<Lanes>::WORDS;
+template <int Lanes> const int real_lanes<Lanes>::LANES;
+template <int Lanes> const size_t real_lanes<Lanes>::WORDS;
+
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef MMWAVE_IWR_CLI_H
+#define MMWAVE_IWR_CLI_H
+
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+
+namespace mmwave
+{
+
+/*
+	Driver for the command line of the radar firmware (cli.c) on the
+	configuration UART.
+
+	A command goes out as one line and the answer is read up to the next
+	prompt: cli.c echoes the line, prints what the handler says, then Done,
+	Error <code> or "'<cmd>' is not recognized as a CLI command", and the
+	prompt. The next command is written as soon as the prompt is back, so
+	a config loads at the speed of the UART instead of 10 ms per character
+	and 110 ms per line. A command that fails, or gets no prompt within the
+	timeout, stops the upload with the firmware's message in error().
+*/
+class iwr_cli
+{
+public:
+	iwr_cli();
+	~iwr_cli();
+
+	// raw 8N1 without flow control, prompt as set by cliCfg.cliPrompt
+	bool open(const std::string& tty, int baud, const std::string& prompt);
+	void close();
+	void set_timeout(int ms) { timeout_ms_ = ms; }
+
+	// ends whatever partial line the CLI holds (power on noise) and waits for a prompt
+	bool sync();
+	bool command(const std::string& line);
+	// every line in order, empty lines skipped, stops at the first that fails
+	bool configure(const std::vector<std::string>& lines);
+
+	// output of the last command without the echo and the prompt
+	const std::string& response() const { return response_; }
+	// code of the last Error line, -1 for an unknown command
+	int error_code() const { return error_code_; }
+	const std::string& error() const { return error_; }
+
+private:
+	bool write_line(const std::string& line);
+	bool read_prompt();
+	bool check(const std::string& line);
+
+	static const int SYNC_TRIES = 5;
+
+	int fd_;
+	std::string prompt_;
+	int timeout_ms_;
+	std::string response_;
+	int error_code_;
+	std::string error_;
+};
+
+}
+
+extern "C" {
+#endif
+
+/*
+	C interface for ctypes (mmWave_class_noQt.py). Every call but
+	iwr_cli_open returns 1 on success and 0 on failure, iwr_cli_error tells
+	why.
+*/
+void* iwr_cli_open(const char* tty, int baud, const char* prompt, int timeout_ms);
+void iwr_cli_close(void* cli);
+int iwr_cli_sync(void* cli);
+int iwr_cli_command(void* cli, const char* line);
+const char* iwr_cli_response(void* cli);
+int iwr_cli_error_code(void* cli);
+const char* iwr_cli_error(void* cli);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
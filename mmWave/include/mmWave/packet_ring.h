@@ -0,0 +1,63 @@
+#ifndef MMWAVE_PACKET_RING_H
+#define MMWAVE_PACKET_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+struct tpacket_block_desc;
+struct tpacket3_hdr;
+
+namespace mmwave
+{
+
+/*
+	AF_PACKET receive ring (TPACKET_V3) for one UDP flow.
+	The kernel fills blocks of packets in a ring mapped into the process, a
+	classic BPF filter keeps only IPv4/UDP datagrams to addr:port. Packets
+	are read straight from the ring, the only syscall is a poll when the
+	next block is not ready yet.
+*/
+class packet_ring
+{
+public:
+	packet_ring();
+	~packet_ring();
+
+	// interface may be empty, the one holding addr is used then
+	bool open(const std::string& interface, const std::string& addr, uint16_t port,
+			  size_t block_size, size_t num_blocks);
+	void close();
+
+	// next UDP payload, its length and kernel receive time (ns), NULL if
+	// nothing arrived within timeout_ms. Valid until the following call.
+	const uint8_t* next_datagram(unsigned& len, uint64_t& stamp, int timeout_ms);
+
+	int fd() const { return fd_; }
+	// packets the kernel had no room for in the ring, updated once per block
+	uint64_t drops() const { return drops_; }
+
+private:
+	bool attach_filter(uint32_t addr, uint16_t port);
+	void release_block();
+	void read_stats();
+
+	int fd_;
+	uint8_t* map_;
+	size_t map_len_;
+	size_t block_size_;
+	size_t num_blocks_;
+
+	size_t block_;				// block being read
+	tpacket_block_desc* desc_;	// NULL if the block is not ours yet
+	tpacket3_hdr* pkt_;
+	uint32_t pkts_left_;
+	uint64_t drops_;
+};
+
+// name of the interface with IPv4 address addr, empty if there is none
+std::string interface_of(const std::string& addr);
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef MMWAVE_RT_H
+#define MMWAVE_RT_H
+
+#include <stddef.h>
+
+namespace mmwave
+{
+
+/*
+	Real time helpers for the capture thread. All of them report why they
+	failed on stderr and return false, capture carries on without the setting.
+*/
+
+// pin the calling thread to cpu
+bool pin_thread(int cpu);
+
+// SCHED_FIFO at priority for the calling thread, needs CAP_SYS_NICE or RLIMIT_RTPRIO
+bool set_fifo(int priority);
+
+// mlockall current and future pages, needs CAP_IPC_LOCK or RLIMIT_MEMLOCK
+bool lock_memory();
+
+// write every page of [addr, addr + len) so no page fault is left for later
+void prefault(void* addr, size_t len);
+
+// touch bytes of stack below the caller so the thread stack is faulted in
+void prefault_stack(size_t bytes);
+
+// warns when cpu is not in isolcpus or nohz_full, false if it is shared
+bool check_isolated(int cpu);
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef MMWAVE_URING_RECV_H
+#define MMWAVE_URING_RECV_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/socket.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+namespace mmwave
+{
+
+/*
+	io_uring receive loop for one datagram socket, on the raw syscalls.
+	A single multishot recvmsg keeps completing into buffers the kernel picks
+	from a provided buffer ring, so there is no syscall per packet: the
+	completion queue is reaped in user space and io_uring_enter is only
+	called to wait when it is empty (or to re-arm the recvmsg). A buffer goes
+	back to the ring once the following datagram is asked for.
+	Control messages come with every datagram, the receive timestamp
+	(SO_TIMESTAMPNS) and the socket drop counter (SO_RXQ_OVFL) are kept.
+	A datagram longer than a buffer is dropped and counted.
+
+	open arms the recvmsg at once, a kernel without multishot recvmsg
+	(before 6.0) rejects it there and open fails. An error that stops the
+	recvmsg for good later on leaves the receiver failed, it is not re-armed.
+*/
+class uring_recv
+{
+public:
+	uring_recv();
+	~uring_recv();
+
+	// num_bufs is rounded up to a power of two, buf_len is the longest datagram
+	bool open(int fd, unsigned num_bufs, unsigned buf_len);
+	void close();
+
+	// next datagram, its length and kernel receive time (ns, 0 if the socket
+	// has no SO_TIMESTAMPNS), NULL if nothing arrived within timeout_ms.
+	// Valid until the following call.
+	const uint8_t* next_datagram(unsigned& len, uint64_t& stamp, int timeout_ms);
+
+	// readable while completions are waiting
+	int fd() const { return ring_fd_; }
+	// last SO_RXQ_OVFL value seen
+	uint32_t socket_drops() const { return socket_drops_; }
+	// datagrams longer than buf_len
+	uint64_t truncated() const { return truncated_; }
+	// the kernel refused the recvmsg, nothing more will be received
+	bool failed() const { return failed_; }
+
+private:
+	bool map_rings();
+	bool setup_buffers();
+	void arm();
+	bool probe();
+	void recycle(unsigned bid);
+	int enter(unsigned to_submit, unsigned min_complete, int timeout_ms);
+
+	int ring_fd_;
+	int sock_fd_;
+
+	// submission and completion queue, shared with the kernel
+	void* sq_map_;
+	size_t sq_map_len_;
+	void* cq_map_;
+	size_t cq_map_len_;
+	io_uring_sqe* sqes_;
+	size_t sqes_len_;
+	unsigned* sq_head_;
+	unsigned* sq_tail_;
+	unsigned* sq_mask_;
+	unsigned* sq_array_;
+	unsigned* cq_head_;
+	unsigned* cq_tail_;
+	unsigned* cq_mask_;
+	io_uring_cqe* cqes_;
+
+	// provided buffers
+	io_uring_buf_ring* buf_ring_;
+	size_t buf_ring_len_;
+	uint8_t* bufs_;
+	unsigned num_bufs_;
+	unsigned buf_len_;
+	uint16_t buf_tail_;
+
+	msghdr msg_;	// recvmsg template, only the control length is used
+	uint32_t socket_drops_;
+	uint64_t truncated_;
+
+	bool armed_;
+	bool failed_;
+	unsigned to_submit_;
+	int held_;	// buffer returned last, -1 if none
+};
+
+}
+
+#endif
@@ -1,6 +1,8 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <sys/mman.h>
 
 /*
 	To compile for debugging:
@@ -12,18 +14,89 @@
 		cc -fPIC -shared -o circ_buff.so circ_buff.c
 */
 
+/*
+	Indices, lengths and sizes are int64_t samples throughout, a ring or a frame can
+	be larger than 2^31 samples and a message larger than 2^15 samples.
+*/
+
+/*
+	Ring memory, 2 MB huge pages cut the TLB misses of copying into and reading
+	out of a ring of many MB. With huge_pages set a MAP_HUGETLB mapping from the
+	hugetlbfs pool (vm.nr_hugepages) is tried first, then a 2 MB aligned mapping
+	the kernel is asked to back with transparent huge pages (only granted when
+	/sys/kernel/mm/transparent_hugepage/enabled is not never). page_mode gets
+	the RING_PAGES_* mode the ring got. The memory is zeroed, the mapping is
+	rounded up to 2 MB, free it with free_ring and the same len. NULL on failure.
+*/
+enum {
+	RING_PAGES_NORMAL,
+	RING_PAGES_HUGETLB,
+	RING_PAGES_THP
+};
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+static size_t ring_map_len(int64_t len)
+{
+	size_t bytes = (size_t)len * sizeof(int16_t);
+	return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+static int thp_enabled(void)
+{
+	char mode[64] = "";
+	FILE* f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+	if (!f) return 0;
+	if (!fgets(mode, sizeof(mode), f)) mode[0] = 0;
+	fclose(f);
+	return strstr(mode, "[never]") == NULL && mode[0] != 0;
+}
+
+int16_t* alloc_ring(int64_t len, int huge_pages, int* page_mode)
+{
+	size_t map_len = ring_map_len(len);
+	uint8_t* p;
+	size_t head;
+
+	*page_mode = RING_PAGES_NORMAL;
+	if (huge_pages) {
+		p = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (p != MAP_FAILED) {
+			*page_mode = RING_PAGES_HUGETLB;
+			return (int16_t*)p;
+		}
+	}
+
+	// 2 MB aligned so every 2 MB of the ring can be one transparent huge page
+	p = mmap(NULL, map_len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) return NULL;
+	head = (HUGE_PAGE_SIZE - ((uintptr_t)p & (HUGE_PAGE_SIZE - 1))) & (HUGE_PAGE_SIZE - 1);
+	if (head) munmap(p, head);
+	munmap(p + head + map_len, HUGE_PAGE_SIZE - head);
+	p += head;
+
+	if (huge_pages && thp_enabled() && madvise(p, map_len, MADV_HUGEPAGE) == 0)
+		*page_mode = RING_PAGES_THP;
+	return (int16_t*)p;
+}
+
+void free_ring(int16_t* ring, int64_t len)
+{
+	if (ring) munmap(ring, ring_map_len(len));
+}
+
 /*
 	This function changes the value of a binary array passed in by reference.
 	If the put idx passes the next frame boundary, the pop_array puts a 1 in the correct
 	location and updates the get idx to be frame boundary.
 */
 
-int16_t find_pops(int64_t  old_put_idx,
+int64_t find_pops(int64_t  old_put_idx,
 			   int64_t  new_put_idx,
 			   int64_t  frame_size)
 {
-	int32_t old_frame_idx = old_put_idx / frame_size;
-	int32_t new_frame_idx = new_put_idx / frame_size;
+	int64_t old_frame_idx = old_put_idx / frame_size;
+	int64_t new_frame_idx = new_put_idx / frame_size;
 	return(old_frame_idx == new_frame_idx) ? -1 : old_frame_idx;
 }
 
@@ -32,22 +105,22 @@ void add_zeros(int64_t num_zeros,
 			   int64_t buffer_len,
 			   int64_t* put_idx,
 			   int64_t frame_size,
-			   int16_t* pop_frame_idx)
+			   int64_t* pop_frame_idx)
 {
-	int32_t new_put_idx = *put_idx;
-	int32_t to_end_of_frame = frame_size - (*put_idx % frame_size); // number of cell to the end of current frame
+	int64_t new_put_idx = *put_idx;
+	int64_t to_end_of_frame = frame_size - (*put_idx % frame_size); // number of cell to the end of current frame
 	if (num_zeros < to_end_of_frame) { // if does not reach the end of the frame
-		memset(buffer + *put_idx, 0, num_zeros * sizeof(buffer[0])); // set zeros accordingly
+		memset(buffer + *put_idx, 0, (size_t)num_zeros * sizeof(buffer[0])); // set zeros accordingly
 		new_put_idx += num_zeros; // move pointer
 	}
 	else {	// if overflow
-		memset(buffer + *put_idx, 0, to_end_of_frame * sizeof(buffer[0])); // set all unfinished cell of frame to 0
+		memset(buffer + *put_idx, 0, (size_t)to_end_of_frame * sizeof(buffer[0])); // set all unfinished cell of frame to 0
 		num_zeros -= to_end_of_frame; // substract those 0 filled
 		new_put_idx += to_end_of_frame; // move to start of the next frame
 		if (new_put_idx >= buffer_len) new_put_idx -= buffer_len; // loop if necessary
 
 		num_zeros %= frame_size; // the rest of the needed zeros (skip 0-filled frames)
-		memset(buffer + new_put_idx, 0, num_zeros * sizeof(buffer[0])); // fill zeros to destination idx
+		memset(buffer + new_put_idx, 0, (size_t)num_zeros * sizeof(buffer[0])); // fill zeros to destination idx
 		new_put_idx += num_zeros; // move pointer
 	}
 	*pop_frame_idx = find_pops(*put_idx, new_put_idx, frame_size);
@@ -55,24 +128,24 @@ void add_zeros(int64_t num_zeros,
 }
 
 void add_msg(int16_t* msg,
-			 int16_t msg_len,
+			 int64_t msg_len,
 			 int16_t* buffer,
 			 int64_t buffer_len,
 			 int64_t* put_idx,
 			 int64_t frame_size,
-			 int16_t* pop_frame_idx)
+			 int64_t* pop_frame_idx)
 {
-	int32_t new_put_idx = *put_idx;
+	int64_t new_put_idx = *put_idx;
 	if (*put_idx + msg_len <= buffer_len) //did not loop around to beginning
 	{
-		memcpy(buffer + *put_idx, msg, msg_len*sizeof(msg[0]));
+		memcpy(buffer + *put_idx, msg, (size_t)msg_len * sizeof(msg[0]));
 		new_put_idx = *put_idx + msg_len; //new location of put idx
 		if (new_put_idx >= buffer_len) new_put_idx -= buffer_len;
 	}
 	else // did loop around to beginning
 	{
-		memcpy(buffer + *put_idx, msg, (buffer_len - *put_idx)*sizeof(msg[0]));
-		memcpy(buffer, msg + (buffer_len - *put_idx), (msg_len - buffer_len + *put_idx)*sizeof(msg[0]));
+		memcpy(buffer + *put_idx, msg, (size_t)(buffer_len - *put_idx) * sizeof(msg[0]));
+		memcpy(buffer, msg + (buffer_len - *put_idx), (size_t)(msg_len - buffer_len + *put_idx) * sizeof(msg[0]));
 		new_put_idx = msg_len - buffer_len + *put_idx;
 	}
 
@@ -80,22 +153,244 @@ void add_msg(int16_t* msg,
 	*put_idx = new_put_idx;
 }
 
-void pad_and_add_msg(int64_t seq_c,
-        int64_t seq_n,
+/*
+	Same bookkeeping as add_msg for a message that has already been written to the
+	buffer at put_idx (wrapping at buffer_len), e.g. by a scatter read straight from
+	the socket. Only moves the put idx and reports the completed frame.
+*/
+void add_in_place(int64_t msg_len,
+			 int64_t buffer_len,
+			 int64_t* put_idx,
+			 int64_t frame_size,
+			 int64_t* pop_frame_idx)
+{
+	int64_t new_put_idx = *put_idx + msg_len;
+	if (new_put_idx >= buffer_len) new_put_idx -= buffer_len;
+
+	*pop_frame_idx = find_pops(*put_idx, new_put_idx, frame_size);
+	*put_idx = new_put_idx;
+}
+
+/*
+	Byte count of the DCA1000 header, the number of ADC bytes sent before the packet.
+*/
+int64_t dca_byte_count(const uint8_t* header)
+{
+	int64_t bytec = 0;
+	int i;
+	for (i = 9; i >= 4; i--) bytec = (bytec << 8) | header[i];
+	return bytec;
+}
+
+/*
+	Restarts the frame being filled at the offset bytec_n has within a frame of the
+	stream, the part of the frame before it is zeroed. Frame boundaries then follow
+	the absolute byte counter again, whatever was added before.
+*/
+void resync(int64_t bytec_n,
+			int16_t* buffer,
+			int64_t* put_idx,
+			int64_t frame_size)
+{
+	int64_t frame_start = *put_idx - (*put_idx % frame_size);
+	int64_t offset = (bytec_n / (int64_t)sizeof(buffer[0])) % frame_size;
+	memset(buffer + frame_start, 0, (size_t)offset * sizeof(buffer[0]));
+	*put_idx = frame_start + offset;
+}
+
+/*
+	A byte count more than a frame behind the expected one is not a late packet but
+	a restarted counter (new recording). bytec_c < 0 means nothing was added yet.
+*/
+int needs_resync(int64_t bytec_c,
+			int64_t bytec_n,
+			int64_t frame_size)
+{
+	return bytec_c < 0 || bytec_n < bytec_c - frame_size * (int64_t)sizeof(int16_t);
+}
+
+/*
+	Gaps are filled from the DCA1000 byte counter so the zero fill is exact for any
+	packet size. bytec_c is the byte count the next packet should carry (bytes placed
+	so far), bytec_n the one it does carry. A packet from before bytec_c (duplicate or
+	late) is dropped, appending it would shift every following frame. The first
+	packet, and one after a counter restart, goes where its byte count puts it in a
+	frame (see resync).
+*/
+void pad_and_add_msg(int64_t bytec_c,
+        int64_t bytec_n,
         int16_t* msg,
-        int16_t msg_len,
+        int64_t msg_len,
         int16_t* buffer,
         int64_t buffer_len,
         int64_t* put_idx,
         int64_t frame_size,
-        int16_t* pop_frame_idx){
+        int64_t* pop_frame_idx){
     //determine if zeros needed
-    int64_t num_zeros = (seq_n - seq_c - 1) * 728;
-    //printf(stderr, "INFO: current sequence number %ld, received %ld\n", seq_c, seq_n);
+    int64_t num_zeros;
+    *pop_frame_idx = -1;
+    if(needs_resync(bytec_c, bytec_n, frame_size)){
+        resync(bytec_n, buffer, put_idx, frame_size);
+        bytec_c = bytec_n;
+    }
+    num_zeros = (bytec_n - bytec_c) / (int64_t)sizeof(buffer[0]);
+    if(num_zeros < 0){
+        return;
+    }
     if(num_zeros > 0){
-        fprintf(stderr, "WARN: Padding %ld zeros\n", num_zeros);
         add_zeros(num_zeros, buffer, buffer_len, put_idx, frame_size, pop_frame_idx);
     }
 
     add_msg(msg, msg_len, buffer, buffer_len, put_idx, frame_size, pop_frame_idx);
 }
+
+/*
+	Integrity of every frame of the ring, frame_infos holds FRAME_INFO_LEN int64 per
+	frame (buffer_len / frame_size rows). A packet is counted in the frame holding
+	its first sample, the packets missing in a gap in the frame the gap starts in.
+	A row is cleared when the put idx enters its frame and is final once the frame
+	is reported complete.
+*/
+enum {
+	INFO_PACKETS,		/* received */
+	INFO_LOST,			/* missing sequence numbers */
+	INFO_ZERO_FILLED,	/* samples */
+	INFO_FIRST_SEQ,		/* of the packets received, -1 if none */
+	INFO_LAST_SEQ,
+	FRAME_INFO_LEN
+};
+
+static void clear_info(int64_t* frame_infos, int64_t frame_idx)
+{
+	int64_t* info = frame_infos + frame_idx * FRAME_INFO_LEN;
+	memset(info, 0, FRAME_INFO_LEN * sizeof(info[0]));
+	info[INFO_FIRST_SEQ] = -1;
+	info[INFO_LAST_SEQ] = -1;
+}
+
+void clear_frame_infos(int64_t* frame_infos, int64_t num_frames)
+{
+	int64_t i;
+	for (i = 0; i < num_frames; i++) clear_info(frame_infos, i);
+}
+
+static void count_packet(int64_t* frame_infos, int64_t frame_idx, int64_t seqn)
+{
+	int64_t* info = frame_infos + frame_idx * FRAME_INFO_LEN;
+	if (info[INFO_PACKETS]++ == 0) info[INFO_FIRST_SEQ] = seqn;
+	info[INFO_LAST_SEQ] = seqn;
+}
+
+/*
+	Sequence number of the DCA1000 header.
+*/
+int64_t dca_seqn(const uint8_t* header)
+{
+	return (int64_t)header[0] | (int64_t)header[1] << 8 | (int64_t)header[2] << 16 | (int64_t)header[3] << 24;
+}
+
+/*
+	Distance put_idx moves when add_zeros is called with num_zeros.
+*/
+int64_t zeros_advance(int64_t num_zeros,
+			   int64_t put_idx,
+			   int64_t frame_size)
+{
+	int64_t to_end_of_frame = frame_size - (put_idx % frame_size);
+	if (num_zeros < to_end_of_frame) return num_zeros;
+	return to_end_of_frame + (num_zeros - to_end_of_frame) % frame_size;
+}
+
+/*
+	Batched version of pad_and_add_msg for packets received with one recvmmsg call.
+	headers holds num_msgs raw 10 byte DCA1000 headers, header_stride bytes apart, and
+	msgs holds the payloads, msg_stride words apart. Both can point into the same array
+	of whole datagrams or into separate header/payload vectors filled by a scatter read.
+	bytec_c is the byte count expected from the next packet (see pad_and_add_msg) and is
+	updated past every packet added, start it at -1. seqn_c is the sequence number of
+	the last packet added, also starting at -1. num_resyncs counts the times the
+	byte counter restarted and the frame boundaries were taken from it again.
+	frame_infos gets the integrity of the frames filled, see FRAME_INFO_LEN, it must
+	be cleared (clear_frame_infos) before the first call.
+	The index of every completed frame is written to pop_frame_idxs, which must have
+	room for 2*num_msgs entries (a gap and its packet can each complete a frame), so
+	a message must not be longer than a frame.
+	The call stops early rather than lap the first frame it completed, num_added is
+	set to the number of messages consumed and the caller hands out the completed
+	frames before adding the rest.
+	Returns the number of completed frames.
+*/
+int64_t pad_and_add_msgs(int64_t* bytec_c,
+        int64_t* seqn_c,
+        const uint8_t* headers,
+        int64_t header_stride,
+        int16_t* msgs,
+        const int64_t* msg_lens,
+        int64_t msg_stride,
+        int64_t num_msgs,
+        int64_t* num_added,
+        int16_t* buffer,
+        int64_t buffer_len,
+        int64_t* put_idx,
+        int64_t frame_size,
+        int64_t* pop_frame_idxs,
+        int64_t* frame_infos,
+        int64_t* num_resyncs){
+    int64_t num_pops = 0;
+    int64_t pop_frame_idx;
+    int64_t i;
+
+    for(i = 0; i < num_msgs; i++){
+        int64_t bytec_n = dca_byte_count(headers + i * header_stride);
+        int64_t seqn_n = dca_seqn(headers + i * header_stride);
+        int64_t num_zeros;
+
+        if(needs_resync(*bytec_c, bytec_n, frame_size)){
+            if(*bytec_c >= 0) (*num_resyncs)++;
+            resync(bytec_n, buffer, put_idx, frame_size);
+            clear_info(frame_infos, *put_idx / frame_size);
+            frame_infos[*put_idx / frame_size * FRAME_INFO_LEN + INFO_ZERO_FILLED] = *put_idx % frame_size;
+            *bytec_c = bytec_n;
+            *seqn_c = -1;
+        }
+        num_zeros = (bytec_n - *bytec_c) / (int64_t)sizeof(buffer[0]);
+
+        /* stale packet, too late for its frame */
+        if(num_zeros < 0) continue;
+
+        if(num_pops > 0){
+            int64_t room = pop_frame_idxs[0] * frame_size - *put_idx;
+            int64_t adv = msg_lens[i];
+            if(room < 0) room += buffer_len;
+            if(num_zeros > 0) adv += zeros_advance(num_zeros, *put_idx, frame_size);
+            if(adv > room) break;
+        }
+
+        if(num_zeros > 0){
+            int64_t* info = frame_infos + *put_idx / frame_size * FRAME_INFO_LEN;
+            int64_t to_end_of_frame = frame_size - (*put_idx % frame_size);
+            if(*seqn_c >= 0 && seqn_n > *seqn_c + 1) info[INFO_LOST] += seqn_n - *seqn_c - 1;
+            add_zeros(num_zeros, buffer, buffer_len, put_idx, frame_size, &pop_frame_idx);
+            if(pop_frame_idx != -1){
+                pop_frame_idxs[num_pops++] = pop_frame_idx;
+                info[INFO_ZERO_FILLED] += to_end_of_frame;
+                clear_info(frame_infos, *put_idx / frame_size);
+                frame_infos[*put_idx / frame_size * FRAME_INFO_LEN + INFO_ZERO_FILLED] = *put_idx % frame_size;
+            }
+            else{
+                info[INFO_ZERO_FILLED] += num_zeros;
+            }
+        }
+
+        count_packet(frame_infos, *put_idx / frame_size, seqn_n);
+        add_msg(msgs + i * msg_stride, msg_lens[i], buffer, buffer_len, put_idx, frame_size, &pop_frame_idx);
+        if(pop_frame_idx != -1){
+            pop_frame_idxs[num_pops++] = pop_frame_idx;
+            clear_info(frame_infos, *put_idx / frame_size);
+        }
+        *bytec_c = bytec_n + msg_lens[i] * (int64_t)sizeof(buffer[0]);
+        *seqn_c = seqn_n;
+    }
+    *num_added = i;
+    return num_pops;
+}
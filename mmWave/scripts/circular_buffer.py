@@ -4,18 +4,43 @@ import Queue
 from ctypes import *
 from numpy.ctypeslib import ndpointer
 import threading
+import time
 import rospkg
 
+# columns of frame_infos, see FRAME_INFO_LEN in circ_buff.c
+INFO_PACKETS, INFO_LOST, INFO_ZERO_FILLED, INFO_FIRST_SEQ, INFO_LAST_SEQ, FRAME_INFO_LEN = range(6)
+# RING_PAGES_* of alloc_ring
+PAGE_MODES = ['4 KB pages', 'hugetlb 2 MB pages', 'transparent huge pages']
+# what add_to_queue does with a frame when the queue is full, as capture_node ~overrun_policy
+OVERRUN_POLICIES = ['drop_newest', 'drop_oldest', 'block']
 
 class ring_buffer:
-    def __init__(self, max_len, frame_size, dtype=np.int16):
+    def __init__(self, max_len, frame_size, dtype=np.int16, huge_pages=False,
+                 queue_frames=8, overrun='drop_newest', block_timeout=0.02):
+        """huge_pages puts the ring on 2 MB pages if the host has any, page_mode
+        tells what it got. Completed frames are copied to a queue of at most
+        queue_frames, a full queue is handled by the overrun policy: drop_newest
+        drops the frame, drop_oldest the oldest queued one, block waits up to
+        block_timeout seconds for the consumer and then drops the frame (and the
+        following ones without waiting until the queue has room again)."""
+        if overrun not in OVERRUN_POLICIES:
+            raise ValueError("overrun must be one of %s" % ', '.join(OVERRUN_POLICIES))
         self.max_len = c_int64(max_len)
-        self.data = np.zeros(max_len, dtype=dtype)
-        self.queue = Queue.Queue()
+        self.queue = Queue.Queue(maxsize=queue_frames)
+        self.overrun = overrun
+        self.block_timeout = block_timeout
+        # overrun counters, the meaning of capture_stats
+        self.dropped_frames = 0
+        self.overwritten_frames = 0
+        self.blocked = 0
+        self.block_timeouts = 0
+        self.blocked_time = 0.0
+        self.timed_out = False  # gave up waiting, do not wait again before the queue has room
         self.put_idx = c_int64(0)
         self.frame_size = c_int64(frame_size)
-        self.pop_array = c_int16(-1)
+        self.pop_array = c_int64(-1)
         self.total = []
+        self.first_stamp = None  # time the frame being filled got its first data
 
         if max_len % frame_size == 0:
             self.n_frames = max_len / frame_size
@@ -26,38 +51,81 @@ class ring_buffer:
 
         self.c_file = CDLL('libcbuffer.so')
 
+        # ring memory comes from alloc_ring so it can be on huge pages
+        self.c_file.alloc_ring.restype = c_void_p
+        self.c_file.alloc_ring.argtypes = [c_int64, c_int, POINTER(c_int)]
+        self.c_file.free_ring.argtypes = [c_void_p, c_int64]
+        page_mode = c_int(0)
+        self.ring_mem = self.c_file.alloc_ring(max_len, int(huge_pages), byref(page_mode))
+        if not self.ring_mem:
+            raise MemoryError("unable to allocate a ring of %d samples" % max_len)
+        self.page_mode = PAGE_MODES[page_mode.value]
+        self.data = np.ctypeslib.as_array(cast(self.ring_mem, POINTER(c_int16)), shape=(max_len,))
+
         self.c_file.add_zeros.argtypes = [
                                             c_int64,
                                             ndpointer(c_int16, flags="C_CONTIGUOUS"),
                                             c_int64,
                                             POINTER(c_int64),
                                             c_int64,
-                                            POINTER(c_int16)
+                                            POINTER(c_int64)
                                          ]
 
         self.c_file.add_msg.argtypes =   [
                                             ndpointer(c_int16, flags="C_CONTIGUOUS"),
-                                            c_int16,
+                                            c_int64,
                                             ndpointer(c_int16, flags="C_CONTIGUOUS"),
                                             c_int64,
                                             POINTER(c_int64),
                                             c_int64,
-                                            POINTER(c_int16)
+                                            POINTER(c_int64)
+        ]
+
+        self.c_file.pad_and_add_msgs.restype = c_int64
+        self.c_file.pad_and_add_msgs.argtypes = [
+            POINTER(c_int64),
+            POINTER(c_int64),
+            c_void_p,
+            c_int64,
+            c_void_p,
+            ndpointer(c_int64, flags="C_CONTIGUOUS"),
+            c_int64,
+            c_int64,
+            POINTER(c_int64),
+            ndpointer(c_int16, flags="C_CONTIGUOUS"),
+            c_int64,
+            POINTER(c_int64),
+            c_int64,
+            ndpointer(c_int64, flags="C_CONTIGUOUS"),
+            ndpointer(c_int64, flags="C_CONTIGUOUS"),
+            POINTER(c_int64)
         ]
+        self.num_added = c_int64(0)
+        self.num_resyncs = c_int64(0)
+        self.seqn = c_int64(-1)  # sequence number of the last packet added
+        # integrity of every frame of the ring, one row per frame
+        self.frame_infos = np.zeros((self.n_frames, FRAME_INFO_LEN), dtype=np.int64)
+        self.c_file.clear_frame_infos.argtypes = [ndpointer(c_int64, flags="C_CONTIGUOUS"), c_int64]
+        self.c_file.clear_frame_infos(self.frame_infos, self.n_frames)
+        self.pop_idxs = np.zeros(0, dtype=np.int64)
 
         self.c_file.pad_and_add_msg.argtypes = [
             c_int64,
             c_int64,
             ndpointer(c_int16, flags="C_CONTIGUOUS"),
-            c_int16,
+            c_int64,
             ndpointer(c_int16, flags="C_CONTIGUOUS"),
             c_int64,
             POINTER(c_int64),
             c_int64,
-            POINTER(c_int16)
+            POINTER(c_int64)
         ]
 
 
+    def __del__(self):
+        if getattr(self, 'ring_mem', None):
+            self.c_file.free_ring(self.ring_mem, self.max_len)
+
     def add_zeros(self,num_zeros):
         self.c_file.add_zeros(num_zeros,
                               self.data,
@@ -78,9 +146,11 @@ class ring_buffer:
                             byref(self.pop_array))
         self.add_to_queue()
 
-    def pad_and_add_msg(self, seq_c, seq_n, msg):
-        self.c_file.pad_and_add_msg(seq_c,
-                                    seq_n,
+    def pad_and_add_msg(self, bytec_c, bytec_n, msg):
+        """bytec_c is the DCA1000 byte count expected next, bytec_n the byte count in
+        the header of msg, the gap between them is zero filled."""
+        self.c_file.pad_and_add_msg(bytec_c,
+                                    bytec_n,
                                     msg,
                                     len(msg),
                                     self.data,
@@ -90,7 +160,85 @@ class ring_buffer:
                                     byref(self.pop_array))
         self.add_to_queue()
 
-    def add_to_queue(self):
+    def pad_and_add_msgs(self, bytec_c, pkts, pkt_lens, num_pkts, stamp=None):
+        """Add num_pkts whole datagrams (header + payload) stored in the rows of the
+        uint8 array pkts with as few C calls as possible. bytec_c is a c_int64 holding
+        the DCA1000 byte count expected next (-1 before the first packet), it is moved
+        past the added packets. Frame boundaries follow the byte counter, a counter
+        restart is counted in num_resyncs. stamp is the receive time of the packets."""
+        if len(self.pop_idxs) < 2*num_pkts:
+            self.pop_idxs = np.zeros(2*num_pkts, dtype=np.int64)
+        msg_lens = ((pkt_lens[:num_pkts] - 10) // 2).astype(np.int64)
+        pkt_stride = pkts.strides[0]
+        done = 0
+        while done < num_pkts:
+            num_pops = self.c_file.pad_and_add_msgs(byref(bytec_c),
+                                                    byref(self.seqn),
+                                                    pkts.ctypes.data + done*pkt_stride,
+                                                    pkt_stride,
+                                                    pkts.ctypes.data + done*pkt_stride + 10,
+                                                    msg_lens[done:],
+                                                    pkt_stride // 2,
+                                                    num_pkts - done,
+                                                    byref(self.num_added),
+                                                    self.data,
+                                                    self.max_len,
+                                                    byref(self.put_idx),
+                                                    self.frame_size,
+                                                    self.pop_idxs,
+                                                    self.frame_infos,
+                                                    byref(self.num_resyncs))
+            for pop_idx in self.pop_idxs[:num_pops]:
+                self.pop_array.value = int(pop_idx)
+                self.add_to_queue(stamp)
+            done += self.num_added.value
+
+    def add_to_queue(self, stamp=None):
+        """Queues (data, first_stamp, last_stamp, info) of a completed frame, info is
+        its frame_infos row (only filled by pad_and_add_msgs). The next frame is taken
+        to start with the packets that completed this one. The copy is made on the
+        receive thread, the ring is not written until it is done."""
+        if stamp is None:
+            stamp = time.time()
         if self.pop_array.value != -1:
             data = self.data[self.frame_size.value * self.pop_array.value:self.frame_size.value * (self.pop_array.value + 1)].copy()
-            self.queue.put(data)
+            info = self.frame_infos[self.pop_array.value].copy()
+            self.put_frame((data, self.first_stamp or stamp, stamp, info))
+            self.first_stamp = stamp
+        elif self.first_stamp is None:
+            self.first_stamp = stamp
+
+    def put_frame(self, frame):
+        """Queue frame following the overrun policy."""
+        try:
+            self.queue.put_nowait(frame)
+            self.timed_out = False
+            return
+        except Queue.Full:
+            pass
+
+        if self.overrun == 'block' and not self.timed_out:
+            self.blocked += 1
+            start = time.time()
+            try:
+                self.queue.put(frame, timeout=self.block_timeout)
+            except Queue.Full:
+                self.block_timeouts += 1
+                self.dropped_frames += 1
+                self.timed_out = True
+            self.blocked_time += time.time() - start
+        elif self.overrun == 'drop_oldest':
+            while True:
+                try:
+                    self.queue.get_nowait()
+                    self.overwritten_frames += 1
+                    self.dropped_frames += 1
+                except Queue.Empty:
+                    pass
+                try:
+                    self.queue.put_nowait(frame)
+                    break
+                except Queue.Full:
+                    continue
+        else:
+            self.dropped_frames += 1
@@ -6,9 +6,9 @@ import os
 import time
 import sys
 import socket
-import serial
 import pdb
 import struct
+import threading
 import numpy as np
 # import RadarRT_lib
 from circular_buffer import ring_buffer
@@ -19,198 +19,194 @@ from radar_config import dict_to_list
 
 class mmWave_Sensor():
     iwr_rec_cmd = ['sensorStop', 'sensorStart']
-    # dca1000evm configuration commands; only the ones used are filled in
-    # TODO: hardcoded comand values should be changed
-    dca_cmd = { \
-        'RESET_FPGA_CMD_CODE'               : b"", \
-        'RESET_AR_DEV_CMD_CODE'             : b"", \
-        'CONFIG_FPGA_GEN_CMD_CODE'          : b"\x5a\xa5\x03\x00\x06\x00\x01\x01\x01\x02\x03\x1e\xaa\xee", \
-        'CONFIG_EEPROM_CMD_CODE'            : b"", \
-        'RECORD_START_CMD_CODE'             : b"\x5a\xa5\x05\x00\x00\x00\xaa\xee", \
-        'RECORD_STOP_CMD_CODE'              : b"\x5a\xa5\x06\x00\x00\x00\xaa\xee", \
-        'PLAYBACK_START_CMD_CODE'           : b"", \
-        'PLAYBACK_STOP_CMD_CODE'            : b"", \
-        'SYSTEM_CONNECT_CMD_CODE'           : b"\x5a\xa5\x09\x00\x00\x00\xaa\xee", \
-        'SYSTEM_ERROR_CMD_CODE'             : b"\x5a\xa5\x0a\x00\x01\x00\xaa\xee", \
-        'CONFIG_PACKET_DATA_CMD_CODE'       : b"\x5a\xa5\x0b\x00\x06\x00\xc0\x05\xc4\x09\x00\x00\xaa\xee", \
-        'CONFIG_DATA_MODE_AR_DEV_CMD_CODE'  : b"", \
-        'INIT_FPGA_PLAYBACK_CMD_CODE'       : b"", \
-        'READ_FPGA_VERSION_CMD_CODE'        : b"\x5a\xa5\x0e\x00\x00\x00\xaa\xee", \
-    }
-
     dca_cmd_addr = ('192.168.33.180', 4096)
-    dca_socket = None
+    dca = None  # dca1000_control handle
     data_socket = None
-    iwr_serial = None
+    iwr_cli = None  # iwr_cli handle
 
-    dca_socket_open = False
     data_socket_open = False
-    serial_open = False
 
     capture_started = 0
 
     data_file = None
 
-    def __init__(self, iwr_cmd_tty='/dev/ttyACM0', iwr_data_tty='/dev/ttyACM1'):
-
-        self.data_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-        self.data_socket.bind(("192.168.33.30", 4098))
-        self.data_socket.settimeout(25e-5)
-        #self.data_socket.setblocking(True)
-        self.data_socket_open = True
-
-        self.seqn = 0  # this is the last packet index
-        self.bytec = 0 # this is a byte counter
-        self.q = Queue.Queue()
-        frame_len = 2*rospy.get_param('iwr_cfg/profiles')[0]['adcSamples']*rospy.get_param('iwr_cfg/numLanes')*rospy.get_param('iwr_cfg/numChirps')
-        self.data_array = ring_buffer(int(2*frame_len), int(frame_len))
+    def __init__(self, iwr_cmd_tty='/dev/ttyACM0', iwr_data_tty='/dev/ttyACM1', native_capture=False):
+
+        # set while the sensor streams, the receive thread sleeps on it otherwise
+        self.capture_event = threading.Event()
+
+        # every board of a multi radar rig sits on its own address, see capture_node ~radars
+        self.host_addr = rospy.get_param('~host_addr', '192.168.33.30')
+        self.dca_cmd_addr = (rospy.get_param('~dca_addr', self.dca_cmd_addr[0]), self.dca_cmd_addr[1])
+
+        # command port client, a board that does not answer fails in deadline*(retries+1)
+        self.dca_lib = CDLL('libdca1000_control.so')
+        self.dca_lib.dca_open.restype = c_void_p
+        self.dca_lib.dca_open.argtypes = [c_char_p, c_char_p, c_int, c_int]
+        self.dca_lib.dca_close.argtypes = [c_void_p]
+        self.dca_lib.dca_setup.argtypes = [c_void_p, c_int, c_int, c_int]
+        self.dca_lib.dca_record_start.argtypes = [c_void_p]
+        self.dca_lib.dca_record_stop.argtypes = [c_void_p]
+        self.dca_lib.dca_fpga_version.argtypes = [c_void_p]
+        self.dca_lib.dca_error.restype = c_char_p
+        self.dca_lib.dca_error.argtypes = [c_void_p]
+
+        # radar command line, a line goes out whole and the next waits for the prompt
+        self.cli_lib = CDLL('libiwr_cli.so')
+        self.cli_lib.iwr_cli_open.restype = c_void_p
+        self.cli_lib.iwr_cli_open.argtypes = [c_char_p, c_int, c_char_p, c_int]
+        self.cli_lib.iwr_cli_close.argtypes = [c_void_p]
+        self.cli_lib.iwr_cli_sync.argtypes = [c_void_p]
+        self.cli_lib.iwr_cli_command.argtypes = [c_void_p, c_char_p]
+        self.cli_lib.iwr_cli_response.restype = c_char_p
+        self.cli_lib.iwr_cli_response.argtypes = [c_void_p]
+        self.cli_lib.iwr_cli_error.restype = c_char_p
+        self.cli_lib.iwr_cli_error.argtypes = [c_void_p]
+        self.cli_prompt = rospy.get_param('~cli_prompt', 'LVDS Stream:/>')
+
+        # with native_capture the data port is owned by capture_node
+        if not native_capture:
+            self.data_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+            self.data_socket.bind((self.host_addr, rospy.get_param('~data_port', 4098)))
+            # blocking, the timeout only lets the receive thread notice sensorStop
+            self.data_socket.settimeout(0.1)
+            #self.data_socket.setblocking(True)
+            self.data_socket_open = True
+
+            self.seqn = 0  # this is the last packet index
+            self.bytec = 0 # this is a byte counter
+            self.next_bytec = c_int64(-1)  # byte count the next packet should carry, -1 until the first
+            # datagrams received per call into the ring, one row per packet
+            self.pkt_buf = np.zeros((32, 2048), dtype=np.uint8)
+            self.pkt_lens = np.zeros(32, dtype=np.int64)
+            self.q = Queue.Queue()
+            frame_len = 2*rospy.get_param('iwr_cfg/profiles')[0]['adcSamples']*rospy.get_param('iwr_cfg/numLanes')*rospy.get_param('iwr_cfg/numChirps')
+            ring_frames = rospy.get_param('~ring_frames', 4)  # frames held by the ring, as in the launch file
+            huge_pages = rospy.get_param('~huge_pages', False)
+            self.data_array = ring_buffer(int(ring_frames*frame_len), int(frame_len), huge_pages=huge_pages,
+                                          queue_frames=rospy.get_param('~queue_frames', 8),
+                                          overrun=rospy.get_param('~overrun_policy', 'drop_newest'),
+                                          block_timeout=rospy.get_param('~overrun_block_ms', 20)*1e-3)
+            if huge_pages:
+                rospy.loginfo("frame ring on %s", self.data_array.page_mode)
 
 
         self.iwr_cmd_tty=iwr_cmd_tty
         self.iwr_data_tty=iwr_data_tty
 
     def close(self):
-        self.dca_socket.close()
-        self.data_socket.close()
-        self.iwr_serial.close()
-
-    def collect_response(self):
-        status = 1
-        while status:
-            try:
-                msg, server = self.dca_socket.recvfrom(2048)
-                import struct
-                (status,) = struct.unpack('<H', msg[4:6])
-
-                if status == 898:
-                    break
-            except Exception as e:
-                print(e)
-                continue
-
-    def collect_arm_response(self):
-        status = 1
-        while status:
-            try:
-                msg, server = self.dca_socket.recvfrom(2048)
-                if msg == self.dca_cmd['SYSTEM_ERROR_CMD_CODE']:
-                    break
-            except Exception as e:
-                print(e)
-                continue
+        if self.dca:
+            self.dca_lib.dca_close(self.dca)
+            self.dca = None
+        if self.data_socket:
+            self.data_socket.close()
+        if self.iwr_cli:
+            self.cli_lib.iwr_cli_close(self.iwr_cli)
+            self.iwr_cli = None
+
+    def dca_check(self, ok, what):
+        if not ok:
+            raise RuntimeError('DCA1000 %s: %s' % (what, self.dca_lib.dca_error(self.dca)))
+
+    def iwr_command(self, cmd):
+        ok = self.cli_lib.iwr_cli_command(self.iwr_cli, cmd.encode('utf-8'))
+        print(self.cli_prompt + cmd)
+        print(self.cli_lib.iwr_cli_response(self.iwr_cli).decode())
+        return ok
+
+    def iwr_check(self, ok):
+        if not ok:
+            raise RuntimeError('IWR %s' % self.cli_lib.iwr_cli_error(self.iwr_cli))
 
     def setupDCA_and_cfgIWR(self):
-        self.dca_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
-        self.dca_socket.bind(("192.168.33.30", 4096))
-        self.dca_socket.settimeout(10)
-        self.dca_socket_open = True
-
-        self.iwr_serial = serial.Serial(port=self.iwr_cmd_tty, baudrate=115200, bytesize=serial.EIGHTBITS,
-                                        parity=serial.PARITY_NONE, stopbits=serial.STOPBITS_ONE, timeout=0.100)
-        self.serial_open = self.iwr_serial.is_open
-
-        if not self.dca_socket or not self.iwr_serial:
-            return
-
-        # Set up DCA
+        self.dca = self.dca_lib.dca_open(self.host_addr.encode(), self.dca_cmd_addr[0].encode(),
+                                         rospy.get_param('~dca_deadline_ms', 100),
+                                         rospy.get_param('~dca_retries', 3))
+        if not self.dca:
+            raise RuntimeError('DCA1000: cannot open the command port on %s' % self.host_addr)
+
+        self.iwr_cli = self.cli_lib.iwr_cli_open(self.iwr_cmd_tty.encode(), 115200, self.cli_prompt.encode(),
+                                                 rospy.get_param('~cli_timeout_ms', 1000))
+        if not self.iwr_cli:
+            raise RuntimeError('IWR: cannot open %s' % self.iwr_cmd_tty)
+
+        # Set up DCA, connect, version, FPGA and packet config go out as one batch
+        # LVDS lanes of the capture card, not the RX antennas of channelCfg (iwr_cfg/numLanes)
         print("SET UP DCA")
-        self.dca_socket.sendto(self.dca_cmd['SYSTEM_CONNECT_CMD_CODE'], self.dca_cmd_addr)
-        import sys
-        print(sys.version)
-        self.collect_response()
-        self.dca_socket.sendto(self.dca_cmd['READ_FPGA_VERSION_CMD_CODE'], self.dca_cmd_addr)
-        self.collect_response()
-        self.dca_socket.sendto(self.dca_cmd['CONFIG_FPGA_GEN_CMD_CODE'], self.dca_cmd_addr)
-        self.collect_response()
-        self.dca_socket.sendto(self.dca_cmd['CONFIG_PACKET_DATA_CMD_CODE'], self.dca_cmd_addr)
-        self.collect_response()
+        self.dca_check(self.dca_lib.dca_setup(self.dca, rospy.get_param('~dca_lvds_lanes', 4),
+                                              rospy.get_param('~dca_packet_size', 1472),
+                                              rospy.get_param('~dca_packet_delay_us', 20)), 'setup')
+        print("FPGA version %d" % self.dca_lib.dca_fpga_version(self.dca))
         print("")
 
         # configure IWR
         print("CONFIGURE IWR")
         iwr_cfg_cmd = dict_to_list(rospy.get_param('iwr_cfg'))
-        # Send and read a few CR to clear things in buffer. Happens sometimes during power on
-        for i in range(5):
-            self.iwr_serial.write('\r'.encode())
-            self.iwr_serial.reset_input_buffer()
-            time.sleep(.1)
+        # end whatever partial line the CLI holds, happens sometimes during power on
+        self.iwr_check(self.cli_lib.iwr_cli_sync(self.iwr_cli))
 
+        start = time.time()
         for cmd in iwr_cfg_cmd:
-            for i in range(len(cmd)):
-                self.iwr_serial.write(cmd[i].encode('utf-8'))
-                time.sleep(0.010)  # 10 ms delay between characters
-            self.iwr_serial.write('\r'.encode())
-            self.iwr_serial.reset_input_buffer()
-            time.sleep(0.010)       # 10 ms delay between characters
-            time.sleep(0.100)       # 100 ms delay between lines
-            response = self.iwr_serial.read(size=6)
-            print('LVDS Stream:/>' + cmd)
-            print(response[2:].decode())
+            self.iwr_check(self.iwr_command(cmd))
+        print("%d commands in %.2f s" % (len(iwr_cfg_cmd), time.time() - start))
         print("")
 
     def arm_dca(self):
-        if not self.dca_socket:
+        if not self.dca:
             return
 
         print("ARM DCA")
-        self.dca_socket.sendto(self.dca_cmd['RECORD_START_CMD_CODE'], self.dca_cmd_addr)
-        self.collect_arm_response()
+        self.dca_check(self.dca_lib.dca_record_start(self.dca), 'record start')
         print("success!")
         print("")
 
     def toggle_capture(self, toggle=0, dir_path=''):
-        if not self.dca_socket or not self.iwr_serial:
+        if not self.dca or not self.iwr_cli:
             return
 
         # only send command if toggle != status of capture
         if toggle == self.capture_started:
             return
 
+        # wake the receive thread before the first packet can arrive
+        if toggle:
+            self.capture_event.set()
+
         sensor_cmd = self.iwr_rec_cmd[toggle]
-        for i in range(len(sensor_cmd)):
-            self.iwr_serial.write(sensor_cmd[i].encode('utf-8'))
-            time.sleep(0.010)   #  10 ms delay between characters
-        self.iwr_serial.write('\r'.encode())
-        self.iwr_serial.reset_input_buffer()
-        time.sleep(0.010)       #  10 ms delay between characters
-        time.sleep(0.100)       # 100 ms delay between lines
-        response = self.iwr_serial.read(size=6)
-        print('LVDS Stream:/>' + sensor_cmd)
-        print(response.decode('utf-8'))
+        ok = self.iwr_command(sensor_cmd)
 
+        # the DCA stops recording even if the radar did not answer
         if sensor_cmd == 'sensorStop':
-            self.dca_socket.sendto(self.dca_cmd['RECORD_STOP_CMD_CODE'], self.dca_cmd_addr)
-            self.collect_response()
+            self.dca_check(self.dca_lib.dca_record_stop(self.dca), 'record stop')
+        self.iwr_check(ok)
 
         self.capture_started = toggle
+        if not toggle:
+            self.capture_event.clear()
 
     def collect_data(self):
+        # block for the first datagram, then drain whatever else is already queued
+        # in the socket so the whole batch goes through the ring in one C call
         try:
-            msg, server = self.data_socket.recvfrom(2048)
-
+            pkt_lens = self.pkt_lens
+            pkt_lens[0] = self.data_socket.recv_into(self.pkt_buf[0])
+            stamp = time.time()  # receive time of the batch
+        except socket.timeout:
+            return
         except Exception as e:
             print(e)
             return
 
+        n = 1
+        while n < len(self.pkt_buf):
+            try:
+                pkt_lens[n] = self.data_socket.recv_into(self.pkt_buf[n], 0, socket.MSG_DONTWAIT)
+            except socket.error:
+                break
+            n += 1
+
         #self.data_file.write(msg)  # keep to compare rosbag with binary here
-        seqn, bytec = struct.unpack('<IIxx', msg[:10])
-        ##print( 'PYTHON: ' + str(self.seqn) + ' ' + str(seqn) )
-        ## print str(self.seqn) + ' ' + str(seqn) #+ ' ' + str(q.qsize())
-        #py_time_start = time.clock()
-        #if self.seqn + 1 != seqn:
-        #    print("@seq {}-{}: ".format(self.seqn, seqn))
-        #    # make for queue below
-        #    num_zeros = c_longlong((seqn - self.seqn - 1) * 728)
-        #    print ('num zeros ',num_zeros.value)
-        #    #num_zeros = (bytec - self.bytec - 1456)//2 #numer of samples not bytes
-        #    self.data_array.add_zeros(num_zeros)
-        #self.data_array.add_msg(np.frombuffer(msg[10:], dtype=np.int16))
-        #py_time_end = time.clock()
-
-        self.data_array.pad_and_add_msg(self.seqn, seqn, np.frombuffer(msg[10:], dtype=np.int16))
-        #c_time_end = time.clock()
-
-        #print("Python took " + str(py_time_end - py_time_start) + ", c took " + str(c_time_end - py_time_end) )
-
-        self.seqn = seqn
-        self.bytec = bytec
+        self.data_array.pad_and_add_msgs(self.next_bytec, self.pkt_buf, pkt_lens, n, stamp)
+
+        self.seqn, bytec_lo, bytec_hi = struct.unpack('<IIH', self.pkt_buf[n-1, :10].tobytes())
+        self.bytec = bytec_lo | (bytec_hi << 32)
@@ -4,15 +4,16 @@ import rospy
 import rospkg
 from std_msgs.msg import String
 from std_msgs.msg import Int16MultiArray
+from std_msgs.msg import Header
 from mmWave.msg import data_frame
 from rospy.numpy_msg import numpy_msg
 import os
 import time
 import sys
 import socket
-import serial
 import pdb
 from mmWave_class_noQt import mmWave_Sensor
+from circular_buffer import INFO_PACKETS, INFO_LOST, INFO_ZERO_FILLED, INFO_FIRST_SEQ, INFO_LAST_SEQ
 import Queue
 import threading
 import pickle
@@ -24,17 +25,27 @@ import json
 def collect_data_thread_func(mmwave_sensor):
     """This function will be run on its own thread and will repeatedly check for incoming radar packets"""
     while True:
-        if mmwave_sensor.capture_started:
-            mmwave_sensor.collect_data()
+        # sleeps until sensorStart, then in recv until packets arrive
+        mmwave_sensor.capture_event.wait()
+        mmwave_sensor.collect_data()
 
 
-def check_and_publish_thread_func(mmwave,pub):
+def check_and_publish_thread_func(mmwave,pub,frame_id):
     """This function will check if any frames have been completed and subsequently put into a queue. This function
     will publish the contents of the queue."""
     while True:
-        if mmwave.capture_started:
-            if mmwave.data_array.queue.qsize() > 0:
-                pub.publish(mmwave.data_array.queue.get())
+        # sleeps until a frame is complete, a get with a timeout polls in python 2
+        data, first_stamp, last_stamp, info = mmwave.data_array.queue.get()
+        header = Header(stamp=rospy.Time.from_sec(first_stamp), frame_id=frame_id)
+        received = int(info[INFO_PACKETS])
+        pub.publish(header=header, first_stamp=header.stamp,
+                    last_stamp=rospy.Time.from_sec(last_stamp),
+                    packets_expected=received + int(info[INFO_LOST]),
+                    packets_received=received,
+                    zero_filled=int(info[INFO_ZERO_FILLED]),
+                    first_seq=max(int(info[INFO_FIRST_SEQ]), 0),
+                    last_seq=max(int(info[INFO_LAST_SEQ]), 0),
+                    data=data)
 
 
 if __name__ == '__main__':
@@ -43,6 +54,9 @@ if __name__ == '__main__':
     parser.add_argument('--cmd_tty', default='/dev/ttyACM0',
                         help='''TTY device or serial port for configuration
                         commands''')
+    parser.add_argument('--native_capture', action='store_true',
+                        help='''only configure the radar and DCA, data is
+                        received and published by capture_node''')
     args = parser.parse_args(rospy.myargv()[1:])
 
     rospy.init_node('radar_collect', anonymous=True)
@@ -68,16 +82,27 @@ if __name__ == '__main__':
 
     iwr_cfg_dict = cfg_list_to_dict(iwr_cfg_cmd)  # store the config params into dictionary
     rospy.set_param('iwr_cfg', iwr_cfg_dict)  # store config dictionary in param server
-    mmwave_sensor = mmWave_Sensor(iwr_cmd_tty=args.cmd_tty)
+    mmwave_sensor = mmWave_Sensor(iwr_cmd_tty=args.cmd_tty, native_capture=args.native_capture)
     mmwave_sensor.setupDCA_and_cfgIWR()
 
-    x = threading.Thread(target=collect_data_thread_func, args=(mmwave_sensor,))
-    x.setDaemon(True)
-    x.start()
-
-    y = threading.Thread(target=check_and_publish_thread_func, args=(mmwave_sensor,pub_radar,))
-    y.setDaemon(True)
-    y.start()
+    if not args.native_capture:
+        x = threading.Thread(target=collect_data_thread_func, args=(mmwave_sensor,))
+        x.setDaemon(True)
+        x.start()
+
+        # same private param as capture_node
+        frame_id = rospy.get_param('~frame_id', 'radar')
+        y = threading.Thread(target=check_and_publish_thread_func, args=(mmwave_sensor,pub_radar,frame_id,))
+        y.setDaemon(True)
+        y.start()
+
+        def log_overrun(event):
+            ring = mmwave_sensor.data_array
+            if ring.dropped_frames:
+                rospy.logwarn("consumer overrun: %d frames dropped (%d of them queued), %d waits for the queue "
+                              "(%d timed out, %.3f s)", ring.dropped_frames, ring.overwritten_frames,
+                              ring.blocked, ring.block_timeouts, ring.blocked_time)
+        overrun_timer = rospy.Timer(rospy.Duration(10), log_overrun)
 
     mmwave_sensor.arm_dca()
     time.sleep(2)
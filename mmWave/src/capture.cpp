@@ -0,0 +1,454 @@
+#include "mmWave/capture.h"
+#include "mmWave/dca1000.h"
+#include "mmWave/rt.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <new>
+
+namespace mmwave
+{
+
+namespace
+{
+// kernel memory charged for a received DCA1000 datagram (skb truesize)
+const int64_t SKB_TRUESIZE = 2304;
+// stack of the receive thread faulted in by lock_memory
+const size_t RT_STACK = 64 * 1024;
+
+// ADC words in a packet of packet_size, 0 if the receive buffers cannot hold it
+int64_t payload_len(int64_t packet_size)
+{
+	int64_t bytes = packet_size - (int64_t)DCA_PACKET_OVERHEAD;
+	if (bytes <= 0 || bytes % sizeof(int16_t) || bytes > (int64_t)(DCA_MAX_PACKET - DCA_HEADER_LEN)) return 0;
+	return bytes / sizeof(int16_t);
+}
+}
+
+const int capture::IDLE_MS;
+
+capture::capture(const capture_config& cfg)
+	: cfg_(cfg), payload_len_(payload_len(cfg.packet_size)), fd_(-1),
+	  pool_(cfg.frame_len, cfg.ring_frames, cfg.huge_pages), queue_(cfg.ring_frames),
+	  assembler_(pool_, queue_, cfg.reorder_window * payload_len_, cfg.overrun, cfg.overrun_block_ms),
+	  rcvbuf_(0), socket_drops_(0), kernel_drops_(0), truncated_warned_(false), running_(false), packets_(0)
+{
+	headers_.resize(MAX_BATCH * DCA_HEADER_LEN);
+	payloads_.resize(MAX_BATCH * payload_len_);
+	msg_lens_.resize(MAX_BATCH);
+	stamps_.resize(MAX_BATCH);
+	// header, payload and the part of an in place payload that goes to the next frame
+	iov_.resize(3 * MAX_BATCH);
+	msgs_.resize(MAX_BATCH);
+	control_.resize(MAX_BATCH * CONTROL_LEN);
+	for (int i = 0; i < MAX_BATCH; ++i) {
+		iov_[3 * i].iov_base = &headers_[i * DCA_HEADER_LEN];
+		iov_[3 * i].iov_len = DCA_HEADER_LEN;
+		iov_[3 * i + 1].iov_base = payloads_.data() + i * payload_len_;
+		iov_[3 * i + 1].iov_len = payload_len_ * sizeof(int16_t);
+		memset(&msgs_[i], 0, sizeof(mmsghdr));
+		msgs_[i].msg_hdr.msg_iov = &iov_[3 * i];
+		msgs_[i].msg_hdr.msg_iovlen = 2;
+		msgs_[i].msg_hdr.msg_control = &control_[i * CONTROL_LEN];
+	}
+}
+
+capture::~capture()
+{
+	stop();
+	if (fd_ >= 0) close(fd_);
+}
+
+void* capture::operator new(size_t size)
+{
+	void* p;
+	if (posix_memalign(&p, alignof(capture), size)) throw std::bad_alloc();
+	return p;
+}
+
+void capture::operator delete(void* p)
+{
+	free(p);
+}
+
+bool capture::open()
+{
+	if (payload_len_ == 0) {
+		fprintf(stderr, "capture: packet size %ld out of range, at most %lu\n", (long)cfg_.packet_size,
+				(unsigned long)(DCA_MAX_PACKET - DCA_HEADER_LEN + DCA_PACKET_OVERHEAD));
+		return false;
+	}
+
+	fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd_ < 0) {
+		perror("capture: socket");
+		return false;
+	}
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(cfg_.data_port);
+	if (inet_pton(AF_INET, cfg_.data_addr.c_str(), &addr.sin_addr) != 1) {
+		fprintf(stderr, "capture: invalid data address %s\n", cfg_.data_addr.c_str());
+		return false;
+	}
+	if (bind(fd_, (sockaddr*)&addr, sizeof(addr)) < 0) {
+		perror("capture: bind");
+		return false;
+	}
+
+	int on = 1;
+	setsockopt(fd_, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on));
+	setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+	if (cfg_.backend != BACKEND_PACKET_RING) size_rcvbuf();
+
+	// wake up periodically so stop() does not hang on a silent board
+	timeval tv;
+	tv.tv_sec = 0;
+	tv.tv_usec = IDLE_MS * 1000;
+	setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	if (cfg_.backend == BACKEND_PACKET_RING) {
+		// the socket only keeps the port open, the ring gets the packets
+		sock_filter drop_all = BPF_STMT(BPF_RET | BPF_K, 0);
+		sock_fprog prog;
+		prog.len = 1;
+		prog.filter = &drop_all;
+		setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+		// the ring rather than the socket buffer has to hold a burst
+		size_t blocks = cfg_.ring_blocks;
+		size_t needed = buffer_bytes() / cfg_.ring_block_size + 1;
+		if (blocks < needed) blocks = needed;
+		rcvbuf_ = blocks * cfg_.ring_block_size;
+		return ring_.open(cfg_.interface, cfg_.data_addr, cfg_.data_port,
+						  cfg_.ring_block_size, blocks);
+	}
+	if (cfg_.backend == BACKEND_URING)
+		return uring_.open(fd_, cfg_.uring_buffers, DCA_HEADER_LEN + payload_len_ * sizeof(int16_t));
+	return true;
+}
+
+// kernel memory needed to hold rcvbuf_ms of the stream, 0 if the rate is not known
+size_t capture::buffer_bytes() const
+{
+	double payload_rate = cfg_.frame_len * sizeof(int16_t) * cfg_.fps;
+	return payload_rate * cfg_.rcvbuf_ms / 1000.0 * SKB_TRUESIZE / (payload_len_ * sizeof(int16_t));
+}
+
+// size the socket buffer from the data rate, the kernel doubles the value
+// set and reports the doubled one, so want is compared with what it reports
+void capture::size_rcvbuf()
+{
+	int want = buffer_bytes();
+	int half = (want + 1) / 2;
+	socklen_t len = sizeof(rcvbuf_);
+	if (half > 0 && setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &half, sizeof(half)) < 0)
+		setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &half, sizeof(half));
+	getsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf_, &len);
+	if (rcvbuf_ < want)
+		fprintf(stderr, "WARN: receive buffer %d bytes, %d wanted for %d ms of data, raise net.core.rmem_max\n",
+				rcvbuf_, want, cfg_.rcvbuf_ms);
+}
+
+void capture::start()
+{
+	if (running_) return;
+	if (cfg_.rt_cpu >= 0) check_isolated(cfg_.rt_cpu);
+	if (cfg_.lock_memory) {
+		// MCL_FUTURE also locks the stack of the thread started below
+		lock_memory();
+		prefault_ring();
+	}
+	running_ = true;
+	thread_ = std::thread(&capture::run, this);
+}
+
+void capture::stop()
+{
+	running_ = false;
+	if (thread_.joinable()) thread_.join();
+	// the receive thread is gone, or a capture_group driving us was stopped first
+	assembler_.flush();
+}
+
+void capture::prefault_ring()
+{
+	prefault(pool_.data(0), pool_.num_slots() * pool_.frame_len() * sizeof(int16_t));
+}
+
+void capture::run()
+{
+	if (cfg_.rt_cpu >= 0) pin_thread(cfg_.rt_cpu);
+	if (cfg_.rt_priority > 0) set_fifo(cfg_.rt_priority);
+	if (cfg_.lock_memory) prefault_stack(RT_STACK);
+
+	// a receive that waited IDLE_MS for nothing means the board stopped streaming
+	while (running_) {
+		int n = receive_once(true);
+		if (n < 0) {
+			fprintf(stderr, "capture: receive failed, stopped\n");
+			break;
+		}
+		if (n == 0) assembler_.flush();
+	}
+	assembler_.flush();
+}
+
+int capture::poll_fd() const
+{
+	if (cfg_.backend == BACKEND_PACKET_RING) return ring_.fd();
+	if (cfg_.backend == BACKEND_URING) return uring_.fd();
+	return fd_;
+}
+
+int capture::poll(int max_packets)
+{
+	int total = 0;
+	while (total < max_packets) {
+		int n = receive_once(false);
+		if (n <= 0) break;
+		total += n;
+	}
+	return total;
+}
+
+// datagrams taken from the kernel, wait blocks for up to IDLE_MS, -1 once
+// the backend failed for good
+int capture::receive_once(bool wait)
+{
+	if (cfg_.backend == BACKEND_PACKET_RING) return receive_packet_ring(wait);
+	if (cfg_.backend == BACKEND_URING) return receive_uring(wait);
+	if (cfg_.in_place) return receive_in_place(wait);
+	return receive(wait);
+}
+
+int capture::receive(bool wait)
+{
+	if (cfg_.in_place) {
+		// undo the ring targets of receive_in_place
+		for (int i = 0; i < MAX_BATCH; ++i) {
+			iov_[3 * i + 1].iov_base = payloads_.data() + i * payload_len_;
+			iov_[3 * i + 1].iov_len = payload_len_ * sizeof(int16_t);
+			msgs_[i].msg_hdr.msg_iovlen = 2;
+		}
+	}
+
+	int n = recv_batch(MAX_BATCH, wait);
+	if (n < 0) return 0;
+
+	int num_msgs = 0;
+	for (int i = 0; i < n; ++i) {
+		unsigned len = msgs_[i].msg_len;
+		if (len < DCA_HEADER_LEN || truncated(i)) continue;
+		// runts are dropped, keep the vectors dense
+		if (num_msgs != i) {
+			memcpy(&headers_[num_msgs * DCA_HEADER_LEN], &headers_[i * DCA_HEADER_LEN], DCA_HEADER_LEN);
+			memcpy(&payloads_[num_msgs * payload_len_], &payloads_[i * payload_len_], len - DCA_HEADER_LEN);
+			stamps_[num_msgs] = stamps_[i];
+		}
+		msg_lens_[num_msgs++] = (len - DCA_HEADER_LEN) / sizeof(int16_t);
+	}
+	add_batch(num_msgs);
+	return n;
+}
+
+int capture::receive_in_place(bool wait)
+{
+	// only aim at the slot being filled and the next one
+	int batch = assembler_.room() / payload_len_;
+	if (batch > MAX_BATCH) batch = MAX_BATCH;
+	if (batch < 1) {
+		// frames shorter than a packet, nothing to gain
+		return receive(wait);
+	}
+
+	// point every payload of the batch at the place it goes if nothing is lost
+	for (int i = 0; i < batch; ++i) {
+		iovec* iov = &iov_[3 * i];
+		int64_t contiguous;
+		iov[1].iov_base = assembler_.target(i * payload_len_, contiguous);
+		if (contiguous >= payload_len_) {
+			iov[1].iov_len = payload_len_ * sizeof(int16_t);
+			msgs_[i].msg_hdr.msg_iovlen = 2;
+		}
+		else {
+			int64_t rest;
+			iov[1].iov_len = contiguous * sizeof(int16_t);
+			iov[2].iov_base = assembler_.target(i * payload_len_ + contiguous, rest);
+			iov[2].iov_len = (payload_len_ - contiguous) * sizeof(int16_t);
+			msgs_[i].msg_hdr.msg_iovlen = 3;
+		}
+	}
+
+	int n = recv_batch(batch, wait);
+	if (n < 0) return 0;
+
+	// fast path: every packet starts where the previous one ended and all but
+	// the last are full size, so each landed where it was aimed
+	bool clean = true;
+	uint64_t bytec = assembler_.position() * sizeof(int16_t);
+	for (int i = 0; i < n && clean; ++i) {
+		dca_header h = parse_dca_header(&headers_[i * DCA_HEADER_LEN]);
+		unsigned len = msgs_[i].msg_len;
+		clean = h.bytec == bytec && len >= DCA_HEADER_LEN && !truncated(i) &&
+				(i == n - 1 || len == DCA_HEADER_LEN + payload_len_ * sizeof(int16_t));
+		bytec += len - DCA_HEADER_LEN;
+	}
+
+	if (clean) {
+		for (int i = 0; i < n; ++i) {
+			dca_header h = parse_dca_header(&headers_[i * DCA_HEADER_LEN]);
+			assembler_.add_in_place(h.seqn, (msgs_[i].msg_len - DCA_HEADER_LEN) / sizeof(int16_t), stamps_[i]);
+		}
+		packets_ += n;
+		return n;
+	}
+
+	// copy the whole batch out before anything is moved in the ring
+	int num_msgs = 0;
+	for (int i = 0; i < n; ++i) {
+		unsigned len = msgs_[i].msg_len;
+		if (len < DCA_HEADER_LEN || truncated(i)) continue;
+		int64_t msg_len = (len - DCA_HEADER_LEN) / sizeof(int16_t);
+		const iovec* iov = &iov_[3 * i];
+		int64_t first = iov[1].iov_len / sizeof(int16_t);
+		if (first > msg_len) first = msg_len;
+		int16_t* dst = &payloads_[num_msgs * payload_len_];
+		memcpy(dst, iov[1].iov_base, first * sizeof(int16_t));
+		if (msg_len > first)
+			memcpy(dst + first, iov[2].iov_base, (msg_len - first) * sizeof(int16_t));
+		memmove(&headers_[num_msgs * DCA_HEADER_LEN], &headers_[i * DCA_HEADER_LEN], DCA_HEADER_LEN);
+		stamps_[num_msgs] = stamps_[i];
+		msg_lens_[num_msgs++] = msg_len;
+	}
+	add_batch(num_msgs);
+	return n;
+}
+
+// recvmmsg into the first batch entries of msgs_, picks up the receive times
+// (SO_TIMESTAMPNS) and the socket drop counter (SO_RXQ_OVFL)
+int capture::recv_batch(int batch, bool wait)
+{
+	for (int i = 0; i < batch; ++i)
+		msgs_[i].msg_hdr.msg_controllen = CONTROL_LEN;
+
+	int n = recvmmsg(fd_, msgs_.data(), batch, wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			perror("capture: recvmmsg");
+		return -1;
+	}
+
+	for (int i = 0; i < n; ++i) {
+		msghdr* mh = &msgs_[i].msg_hdr;
+		stamps_[i] = 0;
+		for (cmsghdr* c = CMSG_FIRSTHDR(mh); c; c = CMSG_NXTHDR(mh, c)) {
+			if (c->cmsg_level != SOL_SOCKET) continue;
+			if (c->cmsg_type == SCM_TIMESTAMPNS) {
+				timespec ts;
+				memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+				stamps_[i] = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+			}
+			else if (c->cmsg_type == SO_RXQ_OVFL) {
+				uint32_t drops;
+				memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+				set_socket_drops(drops);
+			}
+		}
+	}
+	return n;
+}
+
+// datagram i of the last batch was longer than a packet of packet_size and
+// lost its tail, the board streams with another packet size than configured
+bool capture::truncated(int i)
+{
+	if (!(msgs_[i].msg_hdr.msg_flags & MSG_TRUNC)) return false;
+	if (!truncated_warned_) warn_truncated();
+	return true;
+}
+
+void capture::warn_truncated()
+{
+	fprintf(stderr, "WARN: datagram longer than the packet size %ld, dropped, check ~dca_packet_size\n",
+			(long)cfg_.packet_size);
+	truncated_warned_ = true;
+}
+
+// the kernel counters are 32 bit and wrap
+void capture::set_socket_drops(uint32_t drops)
+{
+	kernel_drops_ += (uint32_t)(drops - socket_drops_);
+	socket_drops_ = drops;
+	assembler_.set_kernel_drops(kernel_drops_);
+}
+
+int capture::receive_packet_ring(bool wait)
+{
+	// one datagram at a time, they are read from the mapped ring without a syscall
+	unsigned len;
+	uint64_t stamp;
+	const uint8_t* dgram = ring_.next_datagram(len, stamp, wait ? IDLE_MS : 0);
+	if (ring_.drops() != kernel_drops_) {
+		kernel_drops_ = ring_.drops();
+		assembler_.set_kernel_drops(kernel_drops_);
+	}
+	if (!dgram) return 0;
+	if (len >= DCA_HEADER_LEN)
+		add_packet(dgram, (const int16_t*)(dgram + DCA_HEADER_LEN), (len - DCA_HEADER_LEN) / sizeof(int16_t), stamp);
+	return 1;
+}
+
+int capture::receive_uring(bool wait)
+{
+	// completions are reaped from the shared queue, io_uring_enter only runs when it is empty
+	unsigned len;
+	uint64_t stamp;
+	const uint8_t* dgram = uring_.next_datagram(len, stamp, wait ? IDLE_MS : 0);
+	if (uring_.socket_drops() != socket_drops_) set_socket_drops(uring_.socket_drops());
+	if (uring_.truncated() && !truncated_warned_) warn_truncated();
+	if (!dgram) return uring_.failed() ? -1 : 0;
+	if (len >= DCA_HEADER_LEN)
+		add_packet(dgram, (const int16_t*)(dgram + DCA_HEADER_LEN), (len - DCA_HEADER_LEN) / sizeof(int16_t), stamp);
+	return 1;
+}
+
+// add the first num_msgs entries of the header/payload vectors
+void capture::add_batch(int num_msgs)
+{
+	for (int i = 0; i < num_msgs; ++i)
+		add_packet(&headers_[i * DCA_HEADER_LEN], &payloads_[i * payload_len_], msg_lens_[i], stamps_[i]);
+}
+
+// packets are placed by their byte counter like pad_and_add_msg in circ_buff.c
+void capture::add_packet(const uint8_t* header, const int16_t* payload, int64_t len, uint64_t stamp)
+{
+	// gaps and stale packets are counted by the assembler, no print per packet
+	dca_header h = parse_dca_header(header);
+	assembler_.add_msg(h.seqn, h.bytec / sizeof(int16_t), payload, len, stamp);
+	++packets_;
+}
+
+bool capture::wait_frame(frame& f, int timeout_ms)
+{
+	int64_t slot;
+	if (!queue_.pop(slot, timeout_ms)) return false;
+
+	f.slot = slot;
+	f.data = pool_.data(slot);
+	f.len = pool_.frame_len();
+	f.info = pool_.info(slot);
+	return true;
+}
+
+}
@@ -0,0 +1,135 @@
+#include "mmWave/capture_group.h"
+#include "mmWave/rt.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace mmwave
+{
+
+namespace
+{
+typedef std::chrono::steady_clock clock_type;
+// stack of the receive thread faulted in by lock_memory
+const size_t RT_STACK = 64 * 1024;
+// ready captures taken from one epoll_wait
+const int MAX_EVENTS = 16;
+// epoll data of the stop eventfd, captures are numbered from 0
+const uint32_t STOP_EVENT = 0xffffffff;
+}
+
+const int capture_group::BUDGET;
+
+capture_group::capture_group(int rt_cpu, int rt_priority, bool lock_memory)
+	: rt_cpu_(rt_cpu), rt_priority_(rt_priority), lock_memory_(lock_memory),
+	  stop_fd_(-1), running_(false), wakeups_(0)
+{
+	epfd_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd_ < 0) {
+		perror("capture_group: epoll_create1");
+		return;
+	}
+	stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = STOP_EVENT;
+	if (stop_fd_ < 0 || epoll_ctl(epfd_, EPOLL_CTL_ADD, stop_fd_, &ev) < 0) {
+		perror("capture_group: stop eventfd");
+		close(epfd_);
+		epfd_ = -1;
+	}
+}
+
+capture_group::~capture_group()
+{
+	stop();
+	if (epfd_ >= 0) close(epfd_);
+	if (stop_fd_ >= 0) close(stop_fd_);
+}
+
+bool capture_group::add(capture* cap)
+{
+	if (epfd_ < 0 || running_) return false;
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = caps_.size();
+	if (epoll_ctl(epfd_, EPOLL_CTL_ADD, cap->poll_fd(), &ev) < 0) {
+		perror("capture_group: epoll_ctl");
+		return false;
+	}
+	caps_.push_back(cap);
+	return true;
+}
+
+void capture_group::start()
+{
+	if (running_) return;
+	if (rt_cpu_ >= 0) check_isolated(rt_cpu_);
+	if (lock_memory_) {
+		lock_memory();
+		for (size_t i = 0; i < caps_.size(); ++i) caps_[i]->prefault_ring();
+	}
+	running_ = true;
+	thread_ = std::thread(&capture_group::run, this);
+}
+
+void capture_group::stop()
+{
+	running_ = false;
+	if (!thread_.joinable()) return;
+	uint64_t one = 1;
+	if (write(stop_fd_, &one, sizeof(one)) < 0) perror("capture_group: write");
+	thread_.join();
+}
+
+void capture_group::run()
+{
+	if (rt_cpu_ >= 0) pin_thread(rt_cpu_);
+	if (rt_priority_ > 0) set_fifo(rt_priority_);
+	if (lock_memory_) prefault_stack(RT_STACK);
+
+	epoll_event events[MAX_EVENTS];
+	std::vector<clock_type::time_point> last_packet(caps_.size(), clock_type::now());
+	while (running_) {
+		// no timeout while no board holds frames for late packets, silent boards
+		// cost nothing and stop() writes the stop eventfd
+		int timeout = -1;
+		clock_type::time_point now = clock_type::now();
+		for (size_t i = 0; i < caps_.size(); ++i) {
+			if (!caps_[i]->holding_frames()) continue;
+			int left = capture::IDLE_MS -
+				(int)std::chrono::duration_cast<std::chrono::milliseconds>(now - last_packet[i]).count();
+			if (left < 0) left = 0;
+			if (timeout < 0 || left < timeout) timeout = left;
+		}
+
+		int n = epoll_wait(epfd_, events, MAX_EVENTS, timeout);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("capture_group: epoll_wait");
+			return;
+		}
+		++wakeups_;
+		now = clock_type::now();
+		for (int i = 0; i < n; ++i) {
+			uint32_t k = events[i].data.u32;
+			if (k == STOP_EVENT) return;
+			if (caps_[k]->poll(BUDGET) > 0) last_packet[k] = now;
+		}
+
+		// a board silent for IDLE_MS stopped streaming, its last frames go out
+		for (size_t i = 0; i < caps_.size(); ++i)
+			if (caps_[i]->holding_frames() && now - last_packet[i] >= std::chrono::milliseconds(capture::IDLE_MS))
+				caps_[i]->flush();
+	}
+}
+
+}
@@ -0,0 +1,346 @@
+#include <ros/ros.h>
+#include <mmWave/capture_stats.h>
+#include <mmWave/data_frame.h>
+
+#include "mmWave/capture.h"
+#include "mmWave/capture_group.h"
+#include "mmWave/circ_buff.h"
+#include "mmWave/data_frame_ref.h"
+#include "mmWave/frame_clock.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+	Native replacement for the receive and publish threads of no_Qt.py.
+	no_Qt.py (started with --native_capture) still configures the radar and
+	the DCA1000, this node only owns the data socket, the frame ring and the
+	radar_data publisher.
+
+	With ~radars set one node captures several DCA1000 boards on a single
+	epoll thread, see capture_group. Each entry has a name, its own data
+	address/port and frame_id; the frames go to <name>/radar_data and the
+	frame format is read from <name>/iwr_cfg, where a no_Qt.py started in
+	namespace <name> puts it.
+*/
+
+namespace
+{
+
+// frame length in int16 words, same formula as mmWave_Sensor.__init__, and frame rate
+bool get_stream_cfg(const std::string& param, int64_t& frame_len, double& fps)
+{
+	XmlRpc::XmlRpcValue cfg;
+	if (!ros::param::get(param, cfg)) return false;
+
+	int adc_samples = cfg["profiles"][0]["adcSamples"];
+	int num_lanes = cfg["numLanes"];
+	int num_chirps = cfg["numChirps"];
+	frame_len = 2LL * adc_samples * num_lanes * num_chirps;
+
+	fps = 0;
+	if (cfg.hasMember("fps")) {
+		XmlRpc::XmlRpcValue& v = cfg["fps"];
+		if (v.getType() == XmlRpc::XmlRpcValue::TypeDouble)
+			fps = (double)v;
+		else if (v.getType() == XmlRpc::XmlRpcValue::TypeInt)
+			fps = (int)v;
+	}
+	return true;
+}
+
+mmWave::capture_stats get_stats(const mmwave::capture& cap, const mmwave::frame_clock& clock)
+{
+	mmWave::capture_stats s;
+	s.packets = cap.packets();
+	s.stale_packets = cap.stale_packets();
+	s.reordered = cap.reordered();
+	s.lost_packets = cap.lost_packets();
+	s.kernel_lost = cap.kernel_lost();
+	s.wire_lost = cap.wire_lost();
+	s.kernel_drops = cap.kernel_drops();
+	s.zero_filled = cap.zero_filled();
+	s.resyncs = cap.resyncs();
+	s.frames = cap.frames();
+	s.dropped_frames = cap.dropped_frames();
+	s.overwritten_frames = cap.overwritten_frames();
+	s.blocked = cap.blocked();
+	s.block_timeouts = cap.block_timeouts();
+	s.blocked_time = cap.blocked_ns() * 1e-9;
+	s.queue_high_water = cap.queue_high_water();
+	s.rcvbuf = cap.rcvbuf();
+	s.clock_locked = clock.locked();
+	s.frame_period = clock.period();
+	s.clock_drift_ppm = clock.drift_ppm();
+	s.stamp_jitter = clock.jitter();
+	s.stamp_outliers = clock.outliers();
+	s.clock_resets = clock.resets();
+	return s;
+}
+
+bool parse_overrun(const std::string& name, mmwave::overrun_policy& overrun)
+{
+	if (name == "drop_newest")
+		overrun = mmwave::OVERRUN_DROP_NEWEST;
+	else if (name == "drop_oldest")
+		overrun = mmwave::OVERRUN_DROP_OLDEST;
+	else if (name == "block")
+		overrun = mmwave::OVERRUN_BLOCK;
+	else
+		return false;
+	return true;
+}
+
+bool parse_backend(const std::string& name, mmwave::capture_backend& backend)
+{
+	if (name == "socket")
+		backend = mmwave::BACKEND_SOCKET;
+	else if (name == "packet_ring")
+		backend = mmwave::BACKEND_PACKET_RING;
+	else if (name == "uring")
+		backend = mmwave::BACKEND_URING;
+	else
+		return false;
+	return true;
+}
+
+// publishes frames straight from the capture ring, sleeps while the queue is empty
+class frame_publisher
+{
+public:
+	frame_publisher(mmwave::capture& cap, const ros::Publisher& pub, const std::string& frame_id,
+					double frame_period, size_t clock_window)
+		: cap_(cap), pub_(pub), frame_id_(frame_id), clock_(frame_period, clock_window), running_(true)
+	{
+		thread_ = std::thread(&frame_publisher::run, this);
+	}
+
+	~frame_publisher()
+	{
+		running_ = false;
+		cap_.wake();
+		thread_.join();
+	}
+
+	const mmwave::frame_clock& clock() const { return clock_; }
+
+private:
+	void run()
+	{
+		mmwave::frame f;
+		uint32_t seq = 0;
+		while (running_) {
+			if (!cap_.wait_frame(f, 1000)) continue;
+
+			// kernel receive times of the first and last packet, not the publish time,
+			// the header gets the frame time the clock model fits to them
+			mmwave::data_frame_ref msg;
+			msg.header.seq = seq++;
+			msg.header.frame_id = frame_id_;
+			uint64_t stamp = clock_.update(f.info.index, f.info.first_stamp);
+			if (stamp)
+				msg.header.stamp.fromNSec(stamp);
+			else
+				msg.header.stamp = ros::Time::now();	// all zero filled
+			if (f.info.first_stamp) {
+				msg.first_stamp.fromNSec(f.info.first_stamp);
+				msg.last_stamp.fromNSec(f.info.last_stamp);
+			}
+			msg.packets_expected = f.info.packets + f.info.lost_packets;
+			msg.packets_received = f.info.packets;
+			msg.zero_filled = f.info.zero_filled;
+			msg.reordered = f.info.reordered;
+			msg.kernel_drops = f.info.kernel_drops;
+			msg.first_seq = f.info.first_seq;
+			msg.last_seq = f.info.last_seq;
+			msg.data = f.data;
+			msg.len = f.len;
+			pub_.publish(msg);	// serialized before publish returns
+			cap_.release(f);
+		}
+	}
+
+	mmwave::capture& cap_;
+	ros::Publisher pub_;
+	std::string frame_id_;
+	mmwave::frame_clock clock_;
+	std::atomic<bool> running_;
+	std::thread thread_;
+};
+
+// one DCA1000 board of the node
+struct radar
+{
+	std::string name;		// topic namespace, empty for the single radar
+	std::string iwr_cfg;	// param holding the parsed radar config
+	std::string frame_id;
+	mmwave::capture_config cfg;
+	std::unique_ptr<mmwave::capture> cap;
+	std::unique_ptr<frame_publisher> publisher;
+	ros::Publisher stats_pub;
+};
+
+// the entries of ~radars, every field but name defaults to the node params
+bool get_radars(const ros::NodeHandle& pnh, const mmwave::capture_config& defaults, std::vector<radar>& radars)
+{
+	XmlRpc::XmlRpcValue list;
+	if (!pnh.getParam("radars", list)) return true;
+	if (list.getType() != XmlRpc::XmlRpcValue::TypeArray) return false;
+	for (int i = 0; i < list.size(); ++i) {
+		XmlRpc::XmlRpcValue& entry = list[i];
+		if (entry.getType() != XmlRpc::XmlRpcValue::TypeStruct || !entry.hasMember("name")) return false;
+		radar r;
+		r.name = (std::string)entry["name"];
+		r.iwr_cfg = entry.hasMember("iwr_cfg") ? (std::string)entry["iwr_cfg"] : r.name + "/iwr_cfg";
+		r.frame_id = entry.hasMember("frame_id") ? (std::string)entry["frame_id"] : r.name;
+		r.cfg = defaults;
+		if (entry.hasMember("data_addr")) r.cfg.data_addr = (std::string)entry["data_addr"];
+		if (entry.hasMember("data_port")) r.cfg.data_port = (int)entry["data_port"];
+		if (entry.hasMember("interface")) r.cfg.interface = (std::string)entry["interface"];
+		radars.push_back(std::move(r));
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	ros::init(argc, argv, "radar_capture");
+	ros::NodeHandle nh;
+	ros::NodeHandle pnh("~");
+
+	mmwave::capture_config cfg;
+	int data_port;
+	int packet_size;
+	int ring_frames;
+	int reorder_window;
+	std::string backend;
+	std::string overrun;
+	std::string frame_id;
+	int clock_window;
+	pnh.param<std::string>("frame_id", frame_id, "radar");
+	pnh.param("clock_window", clock_window, 256);
+	pnh.param("rt_cpu", cfg.rt_cpu, cfg.rt_cpu);
+	pnh.param("rt_priority", cfg.rt_priority, cfg.rt_priority);
+	pnh.param("lock_memory", cfg.lock_memory, cfg.lock_memory);
+	pnh.param("huge_pages", cfg.huge_pages, cfg.huge_pages);
+	pnh.param("rcvbuf_ms", cfg.rcvbuf_ms, cfg.rcvbuf_ms);
+	pnh.param<std::string>("data_addr", cfg.data_addr, cfg.data_addr);
+	pnh.param("data_port", data_port, (int)cfg.data_port);
+	// the same ~dca_packet_size no_Qt.py sets the board up with
+	pnh.param("dca_packet_size", packet_size, (int)cfg.packet_size);
+	pnh.param("in_place", cfg.in_place, cfg.in_place);
+	pnh.param("ring_frames", ring_frames, (int)cfg.ring_frames);
+	pnh.param("reorder_window", reorder_window, (int)cfg.reorder_window);
+	pnh.param<std::string>("backend", backend, "socket");
+	pnh.param<std::string>("interface", cfg.interface, cfg.interface);
+	pnh.param<std::string>("overrun_policy", overrun, "drop_newest");
+	pnh.param("overrun_block_ms", cfg.overrun_block_ms, cfg.overrun_block_ms);
+	cfg.data_port = data_port;
+	cfg.packet_size = packet_size;
+	cfg.reorder_window = reorder_window < 0 ? 0 : reorder_window;
+	if (!parse_backend(backend, cfg.backend)) {
+		ROS_FATAL("unknown capture backend %s (socket, packet_ring or uring)", backend.c_str());
+		return 1;
+	}
+	if (!parse_overrun(overrun, cfg.overrun)) {
+		ROS_FATAL("unknown overrun policy %s (drop_newest, drop_oldest or block)", overrun.c_str());
+		return 1;
+	}
+	// two slots are always being filled, at least one more for the publisher
+	cfg.ring_frames = ring_frames < 3 ? 3 : ring_frames;
+
+	std::vector<radar> radars;
+	if (!get_radars(pnh, cfg, radars)) {
+		ROS_FATAL("~radars must be a list of {name, data_addr, data_port, frame_id, iwr_cfg, interface}");
+		return 1;
+	}
+	bool grouped = !radars.empty();
+	if (!grouped) {
+		radars.resize(1);
+		radars[0].iwr_cfg = "iwr_cfg";
+		radars[0].frame_id = frame_id;
+		radars[0].cfg = cfg;
+	}
+
+	// iwr_cfg is set by no_Qt.py once it has parsed the radar config file
+	for (size_t i = 0; i < radars.size(); ++i) {
+		radar& r = radars[i];
+		ROS_INFO("waiting for %s", r.iwr_cfg.c_str());
+		while (ros::ok() && !get_stream_cfg(r.iwr_cfg, r.cfg.frame_len, r.cfg.fps))
+			ros::Duration(0.1).sleep();
+		if (!ros::ok()) return 0;
+		ROS_INFO("%s:%d frame length %ld samples at %.1f fps", r.cfg.data_addr.c_str(), r.cfg.data_port,
+				 (long)r.cfg.frame_len, r.cfg.fps);
+
+		r.cap.reset(new mmwave::capture(r.cfg));
+		if (!r.cap->open()) {
+			ROS_FATAL("unable to open the capture on %s:%d", r.cfg.data_addr.c_str(), r.cfg.data_port);
+			return 1;
+		}
+	}
+
+	// all boards on one thread with the real time settings of the node
+	mmwave::capture_group group(cfg.rt_cpu, cfg.rt_priority, cfg.lock_memory);
+	for (size_t i = 0; i < radars.size(); ++i) {
+		radar& r = radars[i];
+		std::string prefix = r.name.empty() ? "" : r.name + "/";
+		ros::Publisher pub = nh.advertise<mmWave::data_frame>(prefix + "radar_data", 10);
+		r.stats_pub = pnh.advertise<mmWave::capture_stats>(prefix + "stats", 1);
+		if (!grouped)
+			r.cap->start();
+		else if (!group.add(r.cap.get())) {
+			ROS_FATAL("unable to poll the capture of %s", r.name.c_str());
+			return 1;
+		}
+		r.publisher.reset(new frame_publisher(*r.cap, pub, r.frame_id, r.cfg.fps > 0 ? 1e9 / r.cfg.fps : 0,
+											  clock_window < 0 ? 0 : clock_window));
+		ROS_INFO("receive buffer %d bytes", r.cap->rcvbuf());
+		if (cfg.huge_pages) {
+			if (r.cap->page_mode() == RING_PAGES_HUGETLB)
+				ROS_INFO("frame ring on 2 MB huge pages");
+			else if (r.cap->page_mode() == RING_PAGES_THP)
+				ROS_INFO("frame ring on transparent huge pages (no free hugetlb pages)");
+			else
+				ROS_WARN("frame ring on 4 KB pages, no hugetlb pages free and THP disabled");
+		}
+	}
+	if (grouped) {
+		group.start();
+		ROS_INFO("capturing %lu radars on one thread", (unsigned long)radars.size());
+	}
+
+	// counters on ~stats every second, in the log every 10 s
+	int ticks = 0;
+	ros::Timer stats = nh.createTimer(ros::Duration(1.0), [&radars, &ticks](const ros::TimerEvent&) {
+		bool log = ++ticks % 10 == 0;
+		for (size_t i = 0; i < radars.size(); ++i) {
+			radar& r = radars[i];
+			mmWave::capture_stats s = get_stats(*r.cap, r.publisher->clock());
+			r.stats_pub.publish(s);
+			if (!log) continue;
+			ROS_INFO("%spackets %lu reordered %lu stale %lu lost %lu (kernel %lu wire %lu) resyncs %lu "
+					"frames %lu dropped frames %lu queue high water %lu",
+					r.name.empty() ? "" : (r.name + ": ").c_str(),
+					(unsigned long)s.packets, (unsigned long)s.reordered, (unsigned long)s.stale_packets,
+					(unsigned long)s.lost_packets, (unsigned long)s.kernel_lost, (unsigned long)s.wire_lost,
+					(unsigned long)s.resyncs, (unsigned long)s.frames, (unsigned long)s.dropped_frames,
+					(unsigned long)s.queue_high_water);
+			if (s.dropped_frames)
+				ROS_WARN("consumer overrun: %lu frames dropped (%lu of them queued), %lu waits for a slot "
+						 "(%lu timed out, %.3f s)",
+						 (unsigned long)s.dropped_frames, (unsigned long)s.overwritten_frames,
+						 (unsigned long)s.blocked, (unsigned long)s.block_timeouts, s.blocked_time);
+			if (s.clock_locked)
+				ROS_INFO("frame period %.3f ms, clock drift %.1f ppm, stamp jitter %.1f us",
+						 s.frame_period * 1e-6, s.clock_drift_ppm, s.stamp_jitter * 1e-3);
+		}
+	});
+	ros::spin();
+	group.stop();
+	for (size_t i = 0; i < radars.size(); ++i) radars[i].cap->stop();
+	return 0;
+}
@@ -0,0 +1,364 @@
+#include "mmWave/dca1000_control.h"
+#include "mmWave/dca1000.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace mmwave
+{
+
+namespace
+{
+typedef std::chrono::steady_clock clock_type;
+
+const char* cmd_name(uint16_t code)
+{
+	switch (code) {
+	case DCA_RESET_FPGA: return "RESET_FPGA";
+	case DCA_RESET_AR_DEV: return "RESET_AR_DEV";
+	case DCA_CONFIG_FPGA_GEN: return "CONFIG_FPGA_GEN";
+	case DCA_CONFIG_EEPROM: return "CONFIG_EEPROM";
+	case DCA_RECORD_START: return "RECORD_START";
+	case DCA_RECORD_STOP: return "RECORD_STOP";
+	case DCA_PLAYBACK_START: return "PLAYBACK_START";
+	case DCA_PLAYBACK_STOP: return "PLAYBACK_STOP";
+	case DCA_SYSTEM_CONNECT: return "SYSTEM_CONNECT";
+	case DCA_SYSTEM_ERROR: return "SYSTEM_ERROR";
+	case DCA_CONFIG_PACKET_DATA: return "CONFIG_PACKET_DATA";
+	case DCA_CONFIG_DATA_MODE_AR_DEV: return "CONFIG_DATA_MODE_AR_DEV";
+	case DCA_INIT_FPGA_PLAYBACK: return "INIT_FPGA_PLAYBACK";
+	case DCA_READ_FPGA_VERSION: return "READ_FPGA_VERSION";
+	}
+	return "unknown command";
+}
+
+void put16(std::vector<uint8_t>& v, uint16_t x)
+{
+	v.push_back(x & 0xff);
+	v.push_back(x >> 8);
+}
+
+uint16_t get16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+}
+
+std::vector<uint8_t> dca_build_cmd(uint16_t code, const std::vector<uint8_t>& data)
+{
+	std::vector<uint8_t> cmd;
+	cmd.reserve(8 + data.size());
+	put16(cmd, DCA_CMD_HEADER);
+	put16(cmd, code);
+	put16(cmd, data.size());
+	cmd.insert(cmd.end(), data.begin(), data.end());
+	put16(cmd, DCA_CMD_FOOTER);
+	return cmd;
+}
+
+bool dca_parse_response(const uint8_t* p, size_t len, uint16_t& code, uint16_t& status)
+{
+	if (len != DCA_RESPONSE_LEN || get16(p) != DCA_CMD_HEADER || get16(p + 6) != DCA_CMD_FOOTER)
+		return false;
+	code = get16(p + 2);
+	status = get16(p + 4);
+	return true;
+}
+
+std::vector<uint8_t> dca_build_response(uint16_t code, uint16_t status)
+{
+	std::vector<uint8_t> r;
+	r.reserve(DCA_RESPONSE_LEN);
+	put16(r, DCA_CMD_HEADER);
+	put16(r, code);
+	put16(r, status);
+	put16(r, DCA_CMD_FOOTER);
+	return r;
+}
+
+bool dca_parse_cmd(const uint8_t* p, size_t len, uint16_t& code, const uint8_t*& data, size_t& data_len)
+{
+	if (len < 8 || get16(p) != DCA_CMD_HEADER) return false;
+	data_len = get16(p + 4);
+	if (len != 8 + data_len || get16(p + 6 + data_len) != DCA_CMD_FOOTER) return false;
+	code = get16(p + 2);
+	data = p + 6;
+	return true;
+}
+
+dca1000_control::dca1000_control()
+	: fd_(-1), deadline_ms_(100), retries_(3), fpga_version_(0), system_errors_(0), last_system_error_(0)
+{
+	memset(&dca_addr_, 0, sizeof(dca_addr_));
+}
+
+dca1000_control::~dca1000_control()
+{
+	close();
+}
+
+bool dca1000_control::open(const std::string& host_addr, const std::string& dca_addr)
+{
+	close();
+	sockaddr_in host;
+	memset(&host, 0, sizeof(host));
+	host.sin_family = AF_INET;
+	host.sin_port = htons(DCA_CMD_PORT);
+	dca_addr_.sin_family = AF_INET;
+	dca_addr_.sin_port = htons(DCA_CMD_PORT);
+	if (inet_pton(AF_INET, host_addr.c_str(), &host.sin_addr) != 1 ||
+		inet_pton(AF_INET, dca_addr.c_str(), &dca_addr_.sin_addr) != 1) {
+		error_ = "invalid address " + host_addr + " or " + dca_addr;
+		return false;
+	}
+
+	fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd_ < 0 || bind(fd_, (sockaddr*)&host, sizeof(host)) < 0) {
+		error_ = std::string("bind ") + host_addr + ": " + strerror(errno);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void dca1000_control::close()
+{
+	if (fd_ >= 0) ::close(fd_);
+	fd_ = -1;
+}
+
+void dca1000_control::set_timing(int deadline_ms, int retries)
+{
+	deadline_ms_ = deadline_ms > 0 ? deadline_ms : 1;
+	retries_ = retries > 0 ? retries : 0;
+}
+
+dca1000_control::command dca1000_control::make(uint16_t code, const std::vector<uint8_t>& data)
+{
+	command c;
+	c.code = code;
+	c.datagram = dca_build_cmd(code, data);
+	c.sent = 0;
+	c.answered = false;
+	c.status = 0;
+	return c;
+}
+
+bool dca1000_control::setup(const dca_fpga_config& fpga, const dca_packet_config& packet)
+{
+	if (packet.delay_us > DCA_MAX_PACKET_DELAY_US) {
+		char msg[96];
+		snprintf(msg, sizeof(msg), "packet delay %u us out of range, at most %u",
+				 packet.delay_us, DCA_MAX_PACKET_DELAY_US);
+		error_ = msg;
+		return false;
+	}
+
+	std::vector<uint8_t> fpga_data;
+	fpga_data.push_back(fpga.logging_mode);
+	fpga_data.push_back(fpga.lvds_mode);
+	fpga_data.push_back(fpga.transfer_mode);
+	fpga_data.push_back(fpga.capture_mode);
+	fpga_data.push_back(fpga.data_format);
+	fpga_data.push_back(fpga.timer_s);
+
+	std::vector<uint8_t> packet_data;
+	put16(packet_data, packet.packet_size);
+	put16(packet_data, packet.delay_us * 1000 / 8);
+	put16(packet_data, 0);
+
+	std::vector<command> cmds;
+	cmds.push_back(make(DCA_SYSTEM_CONNECT));
+	cmds.push_back(make(DCA_READ_FPGA_VERSION));
+	cmds.push_back(make(DCA_CONFIG_FPGA_GEN, fpga_data));
+	cmds.push_back(make(DCA_CONFIG_PACKET_DATA, packet_data));
+	return run(cmds);
+}
+
+bool dca1000_control::record_start()
+{
+	std::vector<command> cmds(1, make(DCA_RECORD_START));
+	return run(cmds);
+}
+
+bool dca1000_control::record_stop()
+{
+	std::vector<command> cmds(1, make(DCA_RECORD_STOP));
+	return run(cmds);
+}
+
+bool dca1000_control::reset_fpga()
+{
+	std::vector<command> cmds(1, make(DCA_RESET_FPGA));
+	return run(cmds);
+}
+
+bool dca1000_control::reset_ar_dev()
+{
+	std::vector<command> cmds(1, make(DCA_RESET_AR_DEV));
+	return run(cmds);
+}
+
+bool dca1000_control::send(command& c)
+{
+	++c.sent;
+	if (sendto(fd_, &c.datagram[0], c.datagram.size(), 0, (sockaddr*)&dca_addr_, sizeof(dca_addr_)) < 0) {
+		error_ = std::string("send ") + cmd_name(c.code) + ": " + strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+// sends the batch and collects its responses, resending the unanswered ones at every deadline
+bool dca1000_control::run(std::vector<command>& cmds)
+{
+	error_.clear();
+	if (fd_ < 0) {
+		error_ = "not open";
+		return false;
+	}
+	for (size_t i = 0; i < cmds.size(); ++i)
+		if (!send(cmds[i])) return false;
+
+	size_t left = cmds.size();
+	clock_type::time_point deadline = clock_type::now() + std::chrono::milliseconds(deadline_ms_);
+	while (left > 0) {
+		int wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_type::now()).count();
+		if (wait <= 0) {
+			for (size_t i = 0; i < cmds.size(); ++i) {
+				command& c = cmds[i];
+				if (c.answered) continue;
+				if (c.sent > retries_) {
+					char msg[128];
+					snprintf(msg, sizeof(msg), "no response to %s after %d tries of %d ms",
+							 cmd_name(c.code), c.sent, deadline_ms_);
+					error_ = msg;
+					return false;
+				}
+				if (!send(c)) return false;
+			}
+			deadline = clock_type::now() + std::chrono::milliseconds(deadline_ms_);
+			continue;
+		}
+
+		pollfd pfd;
+		pfd.fd = fd_;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, wait) <= 0) continue;
+
+		uint8_t buf[64];
+		ssize_t len;
+		while ((len = recv(fd_, buf, sizeof(buf), 0)) >= 0) {
+			uint16_t code, status;
+			if (!dca_parse_response(buf, len, code, status)) continue;
+			if (code == DCA_SYSTEM_ERROR) {
+				// acknowledges RECORD_START, a late repeat of it matches nothing and is dropped
+				if (status == DCA_RECORD_STARTED) {
+					code = DCA_RECORD_START;
+					status = 0;
+				} else {
+					++system_errors_;
+					last_system_error_ = status;
+					fail_pending(status, cmds);
+					return false;
+				}
+			}
+			for (size_t i = 0; i < cmds.size(); ++i) {
+				command& c = cmds[i];
+				if (c.code != code || c.answered) continue;
+				c.answered = true;
+				c.status = status;
+				--left;
+				break;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < cmds.size(); ++i)
+		if (!check(cmds[i])) return false;
+	return true;
+}
+
+void dca1000_control::fail_pending(uint16_t status, const std::vector<command>& cmds)
+{
+	const char* pending = "no command";
+	for (size_t i = 0; i < cmds.size(); ++i) {
+		if (cmds[i].answered) continue;
+		pending = cmd_name(cmds[i].code);
+		break;
+	}
+	char msg[128];
+	snprintf(msg, sizeof(msg), "SYSTEM_ERROR status %u from the board during %s", status, pending);
+	error_ = msg;
+}
+
+bool dca1000_control::check(const command& c)
+{
+	if (c.code == DCA_READ_FPGA_VERSION) {
+		fpga_version_ = c.status;
+		return true;
+	}
+	if (c.status == 0) return true;
+	char msg[128];
+	snprintf(msg, sizeof(msg), "%s failed with status %u", cmd_name(c.code), c.status);
+	error_ = msg;
+	return false;
+}
+
+}
+
+using mmwave::dca1000_control;
+
+void* dca_open(const char* host_addr, const char* dca_addr, int deadline_ms, int retries)
+{
+	dca1000_control* dca = new dca1000_control();
+	dca->set_timing(deadline_ms, retries);
+	if (!dca->open(host_addr, dca_addr)) {
+		fprintf(stderr, "dca1000_control: %s\n", dca->error().c_str());
+		delete dca;
+		return NULL;
+	}
+	return dca;
+}
+
+void dca_close(void* dca)
+{
+	delete (dca1000_control*)dca;
+}
+
+int dca_setup(void* dca, int lvds_lanes, int packet_size, int packet_delay_us)
+{
+	mmwave::dca_fpga_config fpga;
+	fpga.lvds_mode = lvds_lanes == 2 ? mmwave::DCA_LVDS_2_LANES : mmwave::DCA_LVDS_4_LANES;
+	mmwave::dca_packet_config packet;
+	packet.packet_size = packet_size;
+	packet.delay_us = packet_delay_us;
+	return ((dca1000_control*)dca)->setup(fpga, packet);
+}
+
+int dca_record_start(void* dca)
+{
+	return ((dca1000_control*)dca)->record_start();
+}
+
+int dca_record_stop(void* dca)
+{
+	return ((dca1000_control*)dca)->record_stop();
+}
+
+int dca_fpga_version(void* dca)
+{
+	return ((dca1000_control*)dca)->fpga_version();
+}
+
+const char* dca_error(void* dca)
+{
+	return ((dca1000_control*)dca)->error().c_str();
+}
@@ -0,0 +1,353 @@
+#include "mmWave/dca1000_emulator.h"
+#include "mmWave/dca1000.h"
+#include "mmWave/dca1000_control.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace mmwave
+{
+
+namespace
+{
+// FPGA clock tick of the CONFIG_PACKET_DATA delay
+const int64_t DELAY_TICK_NS = 8;
+// longest sleep while no frame is due, bounds the reaction to stop()
+const int64_t IDLE_NS = 100000000;
+
+uint16_t get16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+void spin_until(dca_streamer::clock_type::time_point t)
+{
+	while (dca_streamer::clock_type::now() < t) {}
+}
+}
+
+const size_t dca_streamer::BATCH;
+
+dca_streamer::dca_streamer(int fd, const dca_impairments& impairments)
+	: fd_(fd), impairments_(impairments), payload_(DCA_MAX_PAYLOAD), delay_ns_(0),
+	  seqn_(1), bytec_(0), rng_(impairments.seed), uniform_(0, 1),
+	  packets_(0), lost_(0), reordered_(0), duplicated_(0)
+{
+	msgs_.reserve(BATCH);
+}
+
+void dca_streamer::restart()
+{
+	seqn_ = 1;
+	bytec_ = 0;
+	tail_.clear();
+}
+
+bool dca_streamer::send_frame(const uint8_t* data, size_t len)
+{
+	return send(data, len, false);
+}
+
+bool dca_streamer::send(const uint8_t* data, size_t len, bool end)
+{
+	// the packets cut [0, total) of the tail followed by data
+	size_t carry = tail_.size();
+	size_t total = carry + len;
+	size_t n = total / payload_;
+	if (end && total % payload_) ++n;
+	size_t used = std::min(total, n * payload_);
+
+	headers_.resize(n * DCA_HEADER_LEN);
+	for (size_t i = 0; i < n; ++i)
+		write_dca_header(&headers_[i * DCA_HEADER_LEN], seqn_ + i, bytec_ + i * payload_);
+
+	// the order on the wire, a lost packet is left out and a duplicate listed twice
+	order_.clear();
+	for (size_t i = 0; i < n; ++i) {
+		if (i + 1 < n && chance(impairments_.reorder)) {
+			++reordered_;
+			emit(i + 1);
+			emit(i++);
+		} else {
+			emit(i);
+		}
+	}
+	seqn_ += n;
+
+	iov_.resize(3 * order_.size());
+	dca_streamer::clock_type::time_point next = clock_type::now();
+	size_t batch = delay_ns_ > 0 ? 1 : BATCH;
+	msgs_.clear();
+	for (size_t j = 0; j < order_.size(); ++j) {
+		size_t k = order_[j];
+		size_t off = k * payload_;
+		size_t stop = std::min(off + payload_, total);
+		iovec* iov = &iov_[3 * j];
+		size_t num_iov = 1;
+		iov[0].iov_base = &headers_[k * DCA_HEADER_LEN];
+		iov[0].iov_len = DCA_HEADER_LEN;
+		if (off < carry) {
+			iov[num_iov].iov_base = &tail_[off];
+			iov[num_iov++].iov_len = std::min(stop, carry) - off;
+		}
+		if (stop > carry) {
+			size_t from = std::max(off, carry);
+			iov[num_iov].iov_base = (void*)(data + from - carry);
+			iov[num_iov++].iov_len = stop - from;
+		}
+
+		mmsghdr m;
+		memset(&m, 0, sizeof(m));
+		m.msg_hdr.msg_iov = iov;
+		m.msg_hdr.msg_iovlen = num_iov;
+		msgs_.push_back(m);
+		if (msgs_.size() == batch) {
+			if (delay_ns_ > 0) {
+				spin_until(next);
+				next += std::chrono::nanoseconds(delay_ns_);
+			}
+			if (!flush(msgs_.size())) return false;
+		}
+	}
+	if (!msgs_.empty() && !flush(msgs_.size())) return false;
+
+	bytec_ += used;
+	if (used < carry)
+		tail_.insert(tail_.end(), data, data + len);
+	else
+		tail_.assign(data + (used - carry), data + len);
+	return true;
+}
+
+void dca_streamer::emit(size_t k)
+{
+	if (chance(impairments_.loss)) {
+		++lost_;
+		return;
+	}
+	order_.push_back(k);
+	if (chance(impairments_.duplicate)) {
+		order_.push_back(k);
+		++duplicated_;
+	}
+}
+
+bool dca_streamer::flush(size_t count)
+{
+	size_t done = 0;
+	while (done < count) {
+		int r = sendmmsg(fd_, &msgs_[done], count - done, 0);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			// nobody listens on the loopback yet, the board does not care either
+			if (errno == ECONNREFUSED) {
+				done = count;
+				break;
+			}
+			perror("dca_streamer: sendmmsg");
+			return false;
+		}
+		done += r;
+	}
+	packets_ += count;
+	msgs_.clear();
+	return true;
+}
+
+dca1000_emulator::dca1000_emulator(const emulator_config& cfg)
+	: cfg_(cfg), cmd_fd_(-1), data_fd_(-1), running_(false), recording_(false), frames_(0),
+	  recording_frames_(0)
+{
+}
+
+dca1000_emulator::~dca1000_emulator()
+{
+	if (cmd_fd_ >= 0) close(cmd_fd_);
+	if (data_fd_ >= 0) close(data_fd_);
+}
+
+bool dca1000_emulator::open()
+{
+	if (cfg_.frame_bytes == 0) {
+		error_ = "frame_bytes not set";
+		return false;
+	}
+	if (!cfg_.file.empty()) {
+		FILE* f = fopen(cfg_.file.c_str(), "rb");
+		if (!f) {
+			error_ = cfg_.file + ": " + strerror(errno);
+			return false;
+		}
+		uint8_t buf[1 << 16];
+		size_t r;
+		while ((r = fread(buf, 1, sizeof(buf), f)) > 0) file_.insert(file_.end(), buf, buf + r);
+		fclose(f);
+		// a trailing partial frame is not replayed
+		file_.resize(file_.size() - file_.size() % cfg_.frame_bytes);
+		if (file_.empty()) {
+			error_ = cfg_.file + " holds less than a frame";
+			return false;
+		}
+	}
+	frame_.resize(cfg_.frame_bytes);
+
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	if (inet_pton(AF_INET, cfg_.addr.c_str(), &a.sin_addr) != 1) {
+		error_ = "invalid address " + cfg_.addr;
+		return false;
+	}
+	cmd_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	data_fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	a.sin_port = htons(DCA_CMD_PORT);
+	if (cmd_fd_ < 0 || bind(cmd_fd_, (sockaddr*)&a, sizeof(a)) < 0) {
+		error_ = "bind " + cfg_.addr + ":4096: " + strerror(errno);
+		return false;
+	}
+	// the data comes from port 4098 of the board as well
+	a.sin_port = htons(DCA_DATA_PORT);
+	if (data_fd_ < 0 || bind(data_fd_, (sockaddr*)&a, sizeof(a)) < 0) {
+		error_ = "bind " + cfg_.addr + ":4098: " + strerror(errno);
+		return false;
+	}
+	int sndbuf = 4 << 20;
+	setsockopt(data_fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+	streamer_.reset(new dca_streamer(data_fd_, cfg_.impairments));
+	if (cfg_.packet_delay_ns >= 0) streamer_->set_packet_delay_ns(cfg_.packet_delay_ns);
+	running_ = true;
+	return true;
+}
+
+void dca1000_emulator::run()
+{
+	typedef dca_streamer::clock_type clock_type;
+	while (running_) {
+		int64_t wait = IDLE_NS;
+		if (recording_)
+			wait = std::min(wait, (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+									  next_frame_ - clock_type::now()).count());
+		if (wait < 0) wait = 0;
+
+		pollfd pfd;
+		pfd.fd = cmd_fd_;
+		pfd.events = POLLIN;
+		timespec ts;
+		ts.tv_sec = wait / 1000000000;
+		ts.tv_nsec = wait % 1000000000;
+		if (ppoll(&pfd, 1, &ts, NULL) > 0) handle_commands();
+
+		if (recording_ && clock_type::now() >= next_frame_) send_frame();
+	}
+}
+
+void dca1000_emulator::handle_commands()
+{
+	uint8_t buf[256];
+	sockaddr_in from;
+	socklen_t from_len = sizeof(from);
+	ssize_t len;
+	while ((len = recvfrom(cmd_fd_, buf, sizeof(buf), 0, (sockaddr*)&from, &from_len)) >= 0) {
+		uint16_t code;
+		const uint8_t* data;
+		size_t data_len;
+		if (!dca_parse_cmd(buf, len, code, data, data_len)) continue;
+		uint16_t status = 0;
+		handle(code, data, data_len, from, status);
+		std::vector<uint8_t> r = dca_build_response(code, status);
+		if (sendto(cmd_fd_, &r[0], r.size(), 0, (sockaddr*)&from, from_len) < 0)
+			perror("dca1000_emulator: sendto");
+		from_len = sizeof(from);
+	}
+}
+
+void dca1000_emulator::handle(uint16_t code, const uint8_t* data, size_t len, const sockaddr_in& from, uint16_t& status)
+{
+	switch (code) {
+	case DCA_READ_FPGA_VERSION:
+		status = cfg_.fpga_version;
+		break;
+	case DCA_CONFIG_PACKET_DATA:
+		if (len < 4 || get16(data) <= DCA_PACKET_OVERHEAD) {
+			status = 1;
+			break;
+		}
+		streamer_->set_payload(std::min((size_t)get16(data) - DCA_PACKET_OVERHEAD, DCA_MAX_PAYLOAD));
+		if (cfg_.packet_delay_ns < 0) streamer_->set_packet_delay_ns(get16(data + 2) * DELAY_TICK_NS);
+		break;
+	case DCA_RECORD_START:
+		if (!start_recording(from)) status = 1;
+		break;
+	case DCA_RECORD_STOP:
+		if (recording_) {
+			streamer_->finish();
+			print_stats();
+		}
+		recording_ = false;
+		break;
+	}
+}
+
+bool dca1000_emulator::start_recording(const sockaddr_in& from)
+{
+	sockaddr_in dest = from;
+	dest.sin_port = htons(cfg_.data_port);
+	if (!cfg_.data_host.empty() && inet_pton(AF_INET, cfg_.data_host.c_str(), &dest.sin_addr) != 1) {
+		fprintf(stderr, "dca1000_emulator: invalid data host %s\n", cfg_.data_host.c_str());
+		return false;
+	}
+	if (connect(data_fd_, (sockaddr*)&dest, sizeof(dest)) < 0) {
+		perror("dca1000_emulator: connect");
+		return false;
+	}
+	streamer_->restart();
+	recording_frames_ = 0;
+	next_frame_ = dca_streamer::clock_type::now();
+	recording_ = true;
+	return true;
+}
+
+void dca1000_emulator::send_frame()
+{
+	const uint8_t* data;
+	if (file_.empty()) {
+		int16_t* w = (int16_t*)&frame_[0];
+		for (size_t k = 0; k < frame_.size() / 2; ++k) w[k] = (int16_t)(recording_frames_ + k);
+		data = &frame_[0];
+	} else {
+		size_t n = file_.size() / cfg_.frame_bytes;
+		data = &file_[(recording_frames_ % n) * cfg_.frame_bytes];
+	}
+	if (!streamer_->send_frame(data, cfg_.frame_bytes)) {
+		recording_ = false;
+		return;
+	}
+	++recording_frames_;
+	++frames_;
+	if (cfg_.frames > 0 && recording_frames_ >= cfg_.frames) {
+		streamer_->finish();
+		print_stats();
+		recording_ = false;
+	}
+
+	// frames that are late are sent at once, not skipped
+	if (cfg_.frame_rate > 0)
+		next_frame_ += std::chrono::nanoseconds((int64_t)(1e9 / cfg_.frame_rate));
+}
+
+void dca1000_emulator::print_stats() const
+{
+	fprintf(stderr, "dca1000_emulator: %llu frames, %llu packets, %llu lost, %llu reordered, %llu duplicated\n",
+			(unsigned long long)recording_frames_, (unsigned long long)streamer_->packets(),
+			(unsigned long long)streamer_->lost(), (unsigned long long)streamer_->reordered(),
+			(unsigned long long)streamer_->duplicated());
+}
+
+}
@@ -0,0 +1,93 @@
+#include "mmWave/dca1000_emulator.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+	dca1000_emulator, a DCA1000EVM on the loopback (or any interface) for
+	benchmarks without the hardware:
+
+		dca1000_emulator -b 262144 -r 10
+
+	with ~dca_addr 127.0.0.2 and ~host_addr 127.0.0.1 for no_Qt.py and
+	~data_addr 127.0.0.1 for capture_node. no_Qt.py configures it like the
+	board, the radar serial port is still needed unless something else
+	drives the command port (dca1000_control).
+*/
+
+namespace
+{
+
+mmwave::dca1000_emulator* emulator = NULL;
+
+void on_signal(int)
+{
+	if (emulator) emulator->stop();
+}
+
+void usage(const char* name)
+{
+	fprintf(stderr,
+			"usage: %s -b frame_bytes [options]\n"
+			"  -b bytes   frame size, 4 * adcSamples * numLanes * numChirps\n"
+			"  -a addr    board address, default 127.0.0.2\n"
+			"  -d addr    capture host, default the sender of RECORD_START\n"
+			"  -p port    data port of the capture host, default 4098\n"
+			"  -r fps     frame rate, 0 for flat out, default 10\n"
+			"  -n frames  frames per recording, default until RECORD_STOP\n"
+			"  -f file    replay frames of bare ADC data (adc_data.bin) instead of a counter,\n"
+			"             raw captures with packet headers go to dca_replay\n"
+			"  -D us      packet delay, default the one of CONFIG_PACKET_DATA\n"
+			"  -L p       packet loss probability\n"
+			"  -R p       packet reorder probability\n"
+			"  -U p       packet duplication probability\n"
+			"  -s seed    seed of the impairments, default 1\n"
+			"  -v n       FPGA version reported, default 898\n",
+			name);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	mmwave::emulator_config cfg;
+	int opt;
+	while ((opt = getopt(argc, argv, "b:a:d:p:r:n:f:D:L:R:U:s:v:h")) != -1) {
+		switch (opt) {
+		case 'b': cfg.frame_bytes = strtoul(optarg, NULL, 0); break;
+		case 'a': cfg.addr = optarg; break;
+		case 'd': cfg.data_host = optarg; break;
+		case 'p': cfg.data_port = atoi(optarg); break;
+		case 'r': cfg.frame_rate = atof(optarg); break;
+		case 'n': cfg.frames = strtoull(optarg, NULL, 0); break;
+		case 'f': cfg.file = optarg; break;
+		case 'D': cfg.packet_delay_ns = (int64_t)(atof(optarg) * 1000); break;
+		case 'L': cfg.impairments.loss = atof(optarg); break;
+		case 'R': cfg.impairments.reorder = atof(optarg); break;
+		case 'U': cfg.impairments.duplicate = atof(optarg); break;
+		case 's': cfg.impairments.seed = strtoul(optarg, NULL, 0); break;
+		case 'v': cfg.fpga_version = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (cfg.frame_bytes == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	mmwave::dca1000_emulator emu(cfg);
+	if (!emu.open()) {
+		fprintf(stderr, "dca1000_emulator: %s\n", emu.error().c_str());
+		return 1;
+	}
+	emulator = &emu;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	fprintf(stderr, "dca1000_emulator: listening on %s:4096\n", cfg.addr.c_str());
+	emu.run();
+	return 0;
+}
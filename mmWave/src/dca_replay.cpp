@@ -0,0 +1,303 @@
+#include "mmWave/dca_replay.h"
+#include "mmWave/dca1000.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/net_tstamp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace mmwave
+{
+
+namespace
+{
+uint64_t now_ns()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void sleep_until(uint64_t t)
+{
+	timespec ts;
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+bool read_file(const std::string& path, std::vector<uint8_t>& buf, std::string& error)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f) {
+		error = path + ": " + strerror(errno);
+		return false;
+	}
+	buf.clear();
+	uint8_t chunk[1 << 16];
+	size_t r;
+	while ((r = fread(chunk, 1, sizeof(chunk), f)) > 0) buf.insert(buf.end(), chunk, chunk + r);
+	fclose(f);
+	return true;
+}
+
+// sequence numbers further apart than this in a row mean the file is not cut right
+const int64_t SEQN_JUMP = 1000;
+}
+
+const size_t dca_replayer::BATCH;
+const int64_t dca_replayer::SPIN_NS;
+const int64_t dca_replayer::TXTIME_LEAD_NS;
+
+bool dca_recording::load(const std::vector<std::string>& files, recording_format format, size_t payload)
+{
+	payload_ = payload;
+	data_.clear();
+	packets_.clear();
+	if (payload_ == 0 || payload_ > DCA_MAX_PAYLOAD) {
+		error_ = "invalid packet payload";
+		return false;
+	}
+
+	std::vector<uint8_t> file;
+	for (size_t i = 0; i < files.size(); ++i) {
+		if (!read_file(files[i], file, error_)) return false;
+		if (format == RECORDING_RAW) {
+			if (!load_raw(file)) {
+				error_ = files[i] + ": " + error_;
+				return false;
+			}
+		} else {
+			data_.insert(data_.end(), file.begin(), file.end());
+		}
+	}
+
+	if (format == RECORDING_FRAMES) {
+		for (size_t off = 0; off < data_.size(); off += payload_) {
+			packet p;
+			p.seqn = packets_.size() + 1;
+			p.bytec = off;
+			p.offset = off;
+			p.len = std::min(payload_, data_.size() - off);
+			packets_.push_back(p);
+		}
+	}
+	if (packets_.empty()) {
+		error_ = "no packets in the recording";
+		return false;
+	}
+	return true;
+}
+
+bool dca_recording::load_raw(const std::vector<uint8_t>& file)
+{
+	size_t pos = 0;
+	size_t jumps = 0, first = packets_.size();
+	while (pos + DCA_HEADER_LEN < file.size()) {
+		dca_header h = parse_dca_header(&file[pos]);
+		packet p;
+		p.seqn = h.seqn;
+		p.bytec = h.bytec;
+		p.offset = data_.size();
+		p.len = std::min(payload_, file.size() - pos - DCA_HEADER_LEN);
+		if (packets_.size() > first) {
+			int64_t d = (int64_t)p.seqn - (int64_t)packets_.back().seqn;
+			if (d > SEQN_JUMP || d < -SEQN_JUMP) ++jumps;
+		}
+		data_.insert(data_.end(), &file[pos + DCA_HEADER_LEN], &file[pos + DCA_HEADER_LEN] + p.len);
+		packets_.push_back(p);
+		pos += DCA_HEADER_LEN + p.len;
+	}
+	if (jumps > (packets_.size() - first) / 2) {
+		error_ = "not a raw capture with this packet payload";
+		return false;
+	}
+	return true;
+}
+
+uint64_t dca_recording::stream_bytes() const
+{
+	uint64_t lo = UINT64_MAX, hi = 0;
+	for (size_t i = 0; i < packets_.size(); ++i) {
+		lo = std::min(lo, packets_[i].bytec);
+		hi = std::max(hi, packets_[i].bytec + packets_[i].len);
+	}
+	return packets_.empty() ? 0 : hi - lo;
+}
+
+dca_replayer::dca_replayer(const dca_recording& rec, const replay_config& cfg)
+	: rec_(rec), cfg_(cfg), fd_(-1), queued_(0), batch_(1), txtime_offset_(0), running_(false), packets_(0),
+	  frames_(0), bytes_(0), paced_(0), lateness_ns_(0), max_lateness_ns_(0), elapsed_ns_(0)
+{
+	headers_.resize(BATCH * DCA_HEADER_LEN);
+	iov_.resize(2 * BATCH);
+	msgs_.resize(BATCH);
+	control_.resize(BATCH * CMSG_SPACE(sizeof(uint64_t)));
+}
+
+dca_replayer::~dca_replayer()
+{
+	if (fd_ >= 0) close(fd_);
+}
+
+bool dca_replayer::open()
+{
+	if (cfg_.frame_rate > 0 && cfg_.frame_bytes == 0) {
+		error_ = "pacing by frame rate needs the frame size";
+		return false;
+	}
+	if (cfg_.speed <= 0) {
+		error_ = "invalid speed";
+		return false;
+	}
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(cfg_.port);
+	if (inet_pton(AF_INET, cfg_.dest.c_str(), &a.sin_addr) != 1) {
+		error_ = "invalid address " + cfg_.dest;
+		return false;
+	}
+	fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd_ < 0 || connect(fd_, (sockaddr*)&a, sizeof(a)) < 0) {
+		error_ = std::string("connect: ") + strerror(errno);
+		return false;
+	}
+	int sndbuf = 4 << 20;
+	setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+	if (cfg_.txtime) {
+		sock_txtime st;
+		st.clockid = cfg_.txtime_tai ? CLOCK_TAI : CLOCK_MONOTONIC;
+		st.flags = 0;
+		if (cfg_.txtime_tai) {
+			timespec tai;
+			clock_gettime(CLOCK_TAI, &tai);
+			txtime_offset_ = (int64_t)((uint64_t)tai.tv_sec * 1000000000ULL + tai.tv_nsec - now_ns());
+		}
+		if (setsockopt(fd_, SOL_SOCKET, SO_TXTIME, &st, sizeof(st)) < 0) {
+			error_ = std::string("SO_TXTIME: ") + strerror(errno);
+			return false;
+		}
+	}
+	running_ = true;
+	return true;
+}
+
+bool dca_replayer::run()
+{
+	const std::vector<dca_recording::packet>& pk = rec_.packets();
+	bool paced = cfg_.frame_rate > 0;
+	double period_ns = paced ? 1e9 / (cfg_.frame_rate * cfg_.speed) : 0;
+	double delay_ns = cfg_.packet_delay_ns / cfg_.speed;
+	batch_ = paced ? 1 : BATCH;
+
+	// a loop continues the stream where the previous one ended
+	uint32_t seqn_lo = UINT32_MAX, seqn_hi = 0;
+	for (size_t i = 0; i < pk.size(); ++i) {
+		seqn_lo = std::min(seqn_lo, pk[i].seqn);
+		seqn_hi = std::max(seqn_hi, pk[i].seqn);
+	}
+	uint64_t bytes_per_loop = rec_.stream_bytes();
+	uint32_t seqn_per_loop = seqn_hi - seqn_lo + 1;
+
+	// the first frame is due a little after now so it is not late already
+	uint64_t t0 = now_ns() + SPIN_NS;
+	int64_t first_frame = -1, frame = -1;
+	uint64_t in_frame = 0;
+	for (int loop = 0; running_ && (cfg_.loops == 0 || loop < cfg_.loops); ++loop) {
+		for (size_t i = 0; i < pk.size() && running_; ++i) {
+			uint64_t bytec = pk[i].bytec + loop * bytes_per_loop;
+			int64_t k = cfg_.frame_bytes ? bytec / cfg_.frame_bytes : 0;
+			if (first_frame < 0) first_frame = k;
+			// a reordered packet of an earlier frame goes with the current one
+			if (k > frame) {
+				frame = k;
+				in_frame = 0;
+				++frames_;
+			}
+			uint64_t due = 0;
+			if (paced) due = t0 + (uint64_t)((frame - first_frame) * period_ns + in_frame * delay_ns);
+			++in_frame;
+			if (!send(pk[i], pk[i].seqn + loop * seqn_per_loop, bytec, due)) return false;
+		}
+	}
+	if (!flush()) return false;
+	elapsed_ns_ = now_ns() - t0;
+	return true;
+}
+
+void dca_replayer::wait_until(uint64_t due)
+{
+	if (cfg_.txtime) {
+		if (due > (uint64_t)TXTIME_LEAD_NS) sleep_until(due - TXTIME_LEAD_NS);
+		return;
+	}
+	if (now_ns() + SPIN_NS < due) sleep_until(due - SPIN_NS);
+	while (now_ns() < due) {}
+}
+
+bool dca_replayer::send(const dca_recording::packet& p, uint32_t seqn, uint64_t bytec, uint64_t due)
+{
+	if (due) {
+		wait_until(due);
+		uint64_t now = now_ns();
+		// with txtime the packet is late if the qdisc gets it after its time
+		uint64_t late = now > due ? now - due : 0;
+		lateness_ns_ += late;
+		max_lateness_ns_ = std::max(max_lateness_ns_, late);
+		++paced_;
+	}
+
+	bytes_ += p.len;
+	size_t n = queued_++;
+	uint8_t* header = &headers_[n * DCA_HEADER_LEN];
+	write_dca_header(header, seqn, bytec);
+	iovec* iov = &iov_[2 * n];
+	iov[0].iov_base = header;
+	iov[0].iov_len = DCA_HEADER_LEN;
+	iov[1].iov_base = (void*)(rec_.data() + p.offset);
+	iov[1].iov_len = p.len;
+
+	mmsghdr& m = msgs_[n];
+	memset(&m, 0, sizeof(m));
+	m.msg_hdr.msg_iov = iov;
+	m.msg_hdr.msg_iovlen = 2;
+	if (cfg_.txtime && due) {
+		uint8_t* control = &control_[n * CMSG_SPACE(sizeof(uint64_t))];
+		m.msg_hdr.msg_control = control;
+		m.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint64_t));
+		cmsghdr* c = CMSG_FIRSTHDR(&m.msg_hdr);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_TXTIME;
+		c->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+		uint64_t t = due + txtime_offset_;
+		memcpy(CMSG_DATA(c), &t, sizeof(t));
+	}
+	return queued_ < batch_ || flush();
+}
+
+bool dca_replayer::flush()
+{
+	size_t done = 0;
+	while (done < queued_) {
+		int r = sendmmsg(fd_, &msgs_[done], queued_ - done, 0);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			// no capture listening on the loopback yet, the board would not notice either
+			if (errno == ECONNREFUSED) break;
+			error_ = std::string("sendmmsg: ") + strerror(errno);
+			return false;
+		}
+		done += r;
+	}
+	packets_ += queued_;
+	queued_ = 0;
+	return true;
+}
+
+}
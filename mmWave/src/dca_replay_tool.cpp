@@ -0,0 +1,123 @@
+#include "mmWave/dca_replay.h"
+#include "mmWave/dca1000.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+	dca_replay, sends recorded captures to a capture node as the DCA1000
+	would, for repeatable throughput and latency benchmarks:
+
+		dca_replay -b 262144 -r 10 adc_data_Raw_0.bin adc_data_Raw_1.bin
+		dca_replay -b 262144 -r 10 -x 4 -l 0 adc_data_Raw_0.bin		(4x, forever)
+		dca_replay -b 262144 -r 0 -F frames adc_data.bin			(flat out)
+
+	No command port is involved, start capture_node (or no_Qt.py with the
+	data port only) before the replay.
+*/
+
+namespace
+{
+
+mmwave::dca_replayer* replayer = NULL;
+
+void on_signal(int)
+{
+	if (replayer) replayer->stop();
+}
+
+void usage(const char* name)
+{
+	fprintf(stderr,
+			"usage: %s [options] file...\n"
+			"  -F fmt     raw (adc_data_Raw_0.bin, packets with header) or frames (bare ADC data), default raw\n"
+			"  -P bytes   ADC bytes per packet, default 1456\n"
+			"  -b bytes   frame size, 4 * adcSamples * numLanes * numChirps\n"
+			"  -r fps     frame rate of the recording, 0 for flat out, default 10\n"
+			"  -x speed   replay speed, default 1\n"
+			"  -D us      packet delay within a frame at speed 1, default 20\n"
+			"  -T qdisc   pace with SO_TXTIME instead of busy waiting, for the fq or the etf qdisc\n"
+			"  -l loops   replays of the files, 0 until interrupted, default 1\n"
+			"  -d addr    capture host, default 127.0.0.1\n"
+			"  -p port    data port, default 4098\n",
+			name);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	mmwave::replay_config cfg;
+	mmwave::recording_format format = mmwave::RECORDING_RAW;
+	size_t payload = mmwave::DCA_MAX_PAYLOAD;
+	int opt;
+	while ((opt = getopt(argc, argv, "F:P:b:r:x:D:T:l:d:p:h")) != -1) {
+		switch (opt) {
+		case 'F':
+			if (strcmp(optarg, "raw") == 0)
+				format = mmwave::RECORDING_RAW;
+			else if (strcmp(optarg, "frames") == 0)
+				format = mmwave::RECORDING_FRAMES;
+			else {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'P': payload = strtoul(optarg, NULL, 0); break;
+		case 'b': cfg.frame_bytes = strtoul(optarg, NULL, 0); break;
+		case 'r': cfg.frame_rate = atof(optarg); break;
+		case 'x': cfg.speed = atof(optarg); break;
+		case 'D': cfg.packet_delay_ns = (int64_t)(atof(optarg) * 1000); break;
+		case 'T':
+			cfg.txtime = true;
+			if (strcmp(optarg, "etf") == 0)
+				cfg.txtime_tai = true;
+			else if (strcmp(optarg, "fq") != 0) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		case 'l': cfg.loops = atoi(optarg); break;
+		case 'd': cfg.dest = optarg; break;
+		case 'p': cfg.port = atoi(optarg); break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	mmwave::dca_recording rec;
+	if (!rec.load(std::vector<std::string>(argv + optind, argv + argc), format, payload)) {
+		fprintf(stderr, "dca_replay: %s\n", rec.error().c_str());
+		return 1;
+	}
+	mmwave::dca_replayer r(rec, cfg);
+	if (!r.open()) {
+		fprintf(stderr, "dca_replay: %s\n", r.error().c_str());
+		return 1;
+	}
+	replayer = &r;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	fprintf(stderr, "dca_replay: %zu packets, %llu bytes per loop\n", rec.packets().size(),
+			(unsigned long long)rec.stream_bytes());
+	bool ok = r.run();
+	double s = r.elapsed_ns() * 1e-9;
+	fprintf(stderr, "dca_replay: %llu packets, %llu frames in %.3f s (%.1f MB/s), lateness mean %.1f us max %.1f us\n",
+			(unsigned long long)r.packets(), (unsigned long long)r.frames(), s,
+			s > 0 ? r.bytes() / s * 1e-6 : 0.0,
+			r.mean_lateness_ns() * 1e-3, r.max_lateness_ns() * 1e-3);
+	if (!ok) {
+		fprintf(stderr, "dca_replay: %s\n", r.error().c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,394 @@
+#include "mmWave/frame_assembler.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+namespace mmwave
+{
+
+namespace
+{
+const size_t MAX_HOLES = 64;
+// how often a blocked producer looks for a free slot
+const std::chrono::microseconds BLOCK_POLL(100);
+}
+
+frame_assembler::frame_assembler(frame_pool& pool, frame_queue& queue, int64_t reorder_window,
+								 overrun_policy overrun, int block_ms)
+	: pool_(pool), queue_(queue), frame_len_(pool.frame_len()), window_(reorder_window),
+	  overrun_(overrun), block_ns_(block_ms * 1000000LL), timed_out_(false),
+	  fill_(0), pos_(0), seqn_(0), synced_(false), scratch_(2 * pool.frame_len(), 0),
+	  pending_(pool.num_slots()), pending_head_(0), pending_count_(0),
+	  holes_(MAX_HOLES + 1), num_holes_(0),
+	  frames_(0), dropped_frames_(0), overwritten_frames_(0), blocked_(0), block_timeouts_(0),
+	  blocked_ns_(0), zero_filled_(0), reordered_(0), stale_packets_(0),
+	  resyncs_(0), kernel_drops_(0), lost_packets_(0), kernel_lost_(0)
+{
+	cur_ = acquire();
+	cur_data_ = data_for(cur_, NULL);
+	next_ = acquire();
+	next_data_ = data_for(next_, cur_data_);
+}
+
+frame_assembler::~frame_assembler()
+{
+	if (cur_ >= 0) pool_.release(cur_);
+	if (next_ >= 0) pool_.release(next_);
+	for (size_t i = 0; i < pending_count_; ++i)
+		pool_.release(pending_[(pending_head_ + i) % pending_.size()].slot);
+}
+
+int64_t frame_assembler::acquire()
+{
+	int64_t slot = pool_.acquire();
+	if (slot >= 0)
+		timed_out_ = false;
+	else if (overrun_ == OVERRUN_DROP_OLDEST && queue_.steal(slot)) {
+		// the consumer never saw it
+		--frames_;
+		++dropped_frames_;
+		++overwritten_frames_;
+	}
+	else if (overrun_ == OVERRUN_BLOCK && !timed_out_)
+		slot = wait_for_slot();
+	if (slot >= 0) memset(&pool_.info(slot), 0, sizeof(frame_info));
+	return slot;
+}
+
+// OVERRUN_BLOCK, polls the pool until the consumer releases a slot or block_ns_ passed
+int64_t frame_assembler::wait_for_slot()
+{
+	++blocked_;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int64_t slot = -1;
+	int64_t waited = 0;
+	while (slot < 0 && waited < block_ns_) {
+		std::this_thread::sleep_for(BLOCK_POLL);
+		slot = pool_.acquire();
+		waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+	blocked_ns_ += waited;
+	if (slot < 0) {
+		++block_timeouts_;
+		timed_out_ = true;
+	}
+	return slot;
+}
+
+// slot memory, or the scratch frame not used by other when no slot was free
+int16_t* frame_assembler::data_for(int64_t slot, const int16_t* other)
+{
+	if (slot >= 0) return pool_.data(slot);
+	return other == &scratch_[0] ? &scratch_[frame_len_] : &scratch_[0];
+}
+
+int16_t* frame_assembler::target(int64_t offset, int64_t& contiguous)
+{
+	int64_t pos = fill_ + offset;
+	if (pos < frame_len_) {
+		contiguous = frame_len_ - pos;
+		return cur_data_ + pos;
+	}
+	contiguous = 2 * frame_len_ - pos;
+	return next_data_ + pos - frame_len_;
+}
+
+bool frame_assembler::add_msg(uint32_t seqn, uint64_t pos, const int16_t* msg, int64_t len, uint64_t stamp)
+{
+	if (!synced_ || pos + frame_len_ + window_ < pos_) resync(pos);
+
+	if (pos < pos_) {
+		if (add_late(seqn, pos, msg, len, stamp)) return true;
+		++stale_packets_;
+		return false;
+	}
+
+	if (pos > pos_) add_zeros(pos - pos_, seqn);
+	count_packet(cur_, seqn);
+	write(msg, len, stamp);
+	seqn_ = seqn;
+	release_ready();
+	return true;
+}
+
+void frame_assembler::add_in_place(uint32_t seqn, int64_t len, uint64_t stamp)
+{
+	synced_ = true;
+	count_packet(cur_, seqn);
+	add_stamp(cur_, stamp);
+	fill_ += len;
+	pos_ += len;
+	while (fill_ >= frame_len_) {
+		int64_t rest = fill_ - frame_len_;
+		complete();
+		fill_ = rest;
+		if (rest > 0) add_stamp(cur_, stamp);
+	}
+	seqn_ = seqn;
+	release_ready();
+}
+
+// restart the frame in progress at the offset pos has in a frame
+void frame_assembler::resync(uint64_t pos)
+{
+	if (synced_) ++resyncs_;
+	synced_ = true;
+
+	// held frames go out as they are, holes of the old stream are forgotten
+	flush();
+	finalize_holes(0, pos_, NULL);
+	if (fill_ > 0) ++dropped_frames_;
+
+	int64_t head = pos % frame_len_;
+	memset(cur_data_, 0, head * sizeof(int16_t));
+	if (cur_ >= 0) {
+		memset(&pool_.info(cur_), 0, sizeof(frame_info));
+		pool_.info(cur_).zero_filled = head;
+	}
+	zero_filled_ += head;
+	fill_ = head;
+	pos_ = pos;
+}
+
+// packet seqn starts in the frame in slot
+void frame_assembler::count_packet(int64_t slot, uint32_t seqn)
+{
+	if (slot < 0) return;
+	frame_info& info = pool_.info(slot);
+	if (info.packets++ == 0 || seqn < info.first_seq) info.first_seq = seqn;
+	if (seqn > info.last_seq) info.last_seq = seqn;
+}
+
+// widen the receive time span of the frame in slot
+void frame_assembler::add_stamp(int64_t slot, uint64_t stamp)
+{
+	if (slot < 0 || stamp == 0) return;
+	frame_info& info = pool_.info(slot);
+	if (info.first_stamp == 0 || stamp < info.first_stamp) info.first_stamp = stamp;
+	if (stamp > info.last_stamp) info.last_stamp = stamp;
+}
+
+void frame_assembler::write(const int16_t* msg, int64_t len, uint64_t stamp)
+{
+	while (len > 0) {
+		add_stamp(cur_, stamp);
+		int64_t n = frame_len_ - fill_;
+		if (n > len) n = len;
+		memcpy(cur_data_ + fill_, msg, n * sizeof(int16_t));
+		msg += n;
+		len -= n;
+		fill_ += n;
+		pos_ += n;
+		if (fill_ == frame_len_) complete();
+	}
+}
+
+// zero fill up to the packet seqn, whole frames of zeros are skipped
+void frame_assembler::add_zeros(int64_t num_zeros, uint32_t seqn)
+{
+	if (num_holes_ == MAX_HOLES) finalize_holes(0, holes_[0].end, NULL);
+	hole& h = holes_[num_holes_++];
+	h.start = pos_;
+	h.end = pos_ + num_zeros;
+	h.seq_lo = seqn_ + 1;
+	h.seq_hi = seqn - 1;
+	zero_filled_ += num_zeros;
+
+	int64_t to_end_of_frame = frame_len_ - fill_;
+	if (num_zeros >= to_end_of_frame) {
+		memset(cur_data_ + fill_, 0, to_end_of_frame * sizeof(int16_t));
+		if (cur_ >= 0) pool_.info(cur_).zero_filled += to_end_of_frame;
+		fill_ += to_end_of_frame;
+		pos_ += to_end_of_frame;
+		complete();
+
+		num_zeros -= to_end_of_frame;
+		pos_ += num_zeros / frame_len_ * frame_len_;
+		num_zeros %= frame_len_;
+	}
+	memset(cur_data_ + fill_, 0, num_zeros * sizeof(int16_t));
+	if (cur_ >= 0) pool_.info(cur_).zero_filled += num_zeros;
+	fill_ += num_zeros;
+	pos_ += num_zeros;
+}
+
+// frame still held by the producer that contains stream sample pos
+int16_t* frame_assembler::held_frame(uint64_t pos, int64_t& slot, uint64_t& base)
+{
+	base = pos_ - fill_;
+	if (pos >= base && pos < pos_) {
+		slot = cur_;
+		return cur_data_;
+	}
+	for (size_t i = 0; i < pending_count_; ++i) {
+		const pending& p = pending_[(pending_head_ + i) % pending_.size()];
+		if (pos >= p.base && pos < p.base + frame_len_) {
+			slot = p.slot;
+			base = p.base;
+			return pool_.data(p.slot);
+		}
+	}
+	return NULL;
+}
+
+// place a packet from behind the fill position into the hole it belongs to
+bool frame_assembler::add_late(uint32_t seqn, uint64_t pos, const int16_t* msg, int64_t len, uint64_t stamp)
+{
+	size_t i = 0;
+	while (i < num_holes_ && !(holes_[i].start <= pos && pos + len <= holes_[i].end)) ++i;
+	if (i == num_holes_) return false;
+
+	// every part of it must still be in a held frame
+	for (int64_t done = 0; done < len; ) {
+		int64_t slot;
+		uint64_t base;
+		if (!held_frame(pos + done, slot, base)) return false;
+		done += base + frame_len_ - (pos + done);
+	}
+
+	for (int64_t done = 0; done < len; ) {
+		int64_t slot;
+		uint64_t base;
+		int16_t* data = held_frame(pos + done, slot, base);
+		int64_t n = base + frame_len_ - (pos + done);
+		if (n > len - done) n = len - done;
+		memcpy(data + (pos + done - base), msg + done, n * sizeof(int16_t));
+		if (slot >= 0) {
+			frame_info& info = pool_.info(slot);
+			if (done == 0) {
+				++info.reordered;
+				count_packet(slot, seqn);
+			}
+			info.zero_filled -= n;
+			add_stamp(slot, stamp);
+		}
+		done += n;
+	}
+	zero_filled_ -= len;
+	++reordered_;
+
+	// split the hole around the packet
+	hole h = holes_[i];
+	hole left = h, right = h;
+	left.end = pos;
+	left.seq_hi = seqn - 1;
+	right.start = pos + len;
+	right.seq_lo = seqn + 1;
+	memmove(&holes_[i], &holes_[i + 1], (num_holes_ - i - 1) * sizeof(hole));
+	--num_holes_;
+	if (right.start < right.end) {
+		memmove(&holes_[i + 1], &holes_[i], (num_holes_ - i) * sizeof(hole));
+		holes_[i] = right;
+		++num_holes_;
+	}
+	if (left.start < left.end) {
+		memmove(&holes_[i + 1], &holes_[i], (num_holes_ - i) * sizeof(hole));
+		holes_[i] = left;
+		++num_holes_;
+	}
+	// one more than fits, the oldest hole is given up like in add_zeros
+	if (num_holes_ > MAX_HOLES) finalize_holes(0, holes_[0].end, NULL);
+	return true;
+}
+
+void frame_assembler::complete()
+{
+	uint64_t base = pos_ - fill_;
+	if (cur_ < 0) {
+		finalize_holes(base, base + frame_len_, NULL);
+		++dropped_frames_;
+	}
+	else {
+		pending& p = pending_[(pending_head_ + pending_count_++) % pending_.size()];
+		p.slot = cur_;
+		p.base = base;
+	}
+
+	cur_ = next_;
+	cur_data_ = next_data_;
+	next_ = acquire();
+	next_data_ = data_for(next_, cur_data_);
+	fill_ = 0;
+}
+
+// hand out the frames the reorder window has moved past
+void frame_assembler::release_ready()
+{
+	while (pending_count_ > 0) {
+		const pending& p = pending_[pending_head_];
+		// a packet trailing by the whole window can still come
+		if (pos_ <= p.base + frame_len_ + window_) break;
+		release(p);
+		pending_head_ = (pending_head_ + 1) % pending_.size();
+		--pending_count_;
+	}
+}
+
+void frame_assembler::flush()
+{
+	while (pending_count_ > 0) {
+		release(pending_[pending_head_]);
+		pending_head_ = (pending_head_ + 1) % pending_.size();
+		--pending_count_;
+	}
+}
+
+void frame_assembler::release(const pending& p)
+{
+	frame_info& info = pool_.info(p.slot);
+	info.index = p.base / frame_len_;
+	finalize_holes(p.base, p.base + frame_len_, &info);
+	if (queue_.push(p.slot)) {
+		++frames_;	// the reference now belongs to the consumer
+	}
+	else {
+		pool_.release(p.slot);
+		++dropped_frames_;
+	}
+}
+
+/*
+	The holes before end can no longer be repaired. Their missing packets are
+	spread evenly over each hole and the ones starting in [base, end) are
+	counted as lost in info, the ones before base belong to skipped frames.
+	Kernel drops not blamed yet are blamed on the earliest of them.
+*/
+void frame_assembler::finalize_holes(uint64_t base, uint64_t end, frame_info* info)
+{
+	while (num_holes_ > 0 && holes_[0].start < end) {
+		hole& h = holes_[0];
+		uint64_t len = h.end - h.start;
+		uint64_t missing = h.seq_hi >= h.seq_lo ? (uint64_t)(h.seq_hi - h.seq_lo) + 1 : 0;
+
+		// packets k = 0..missing-1 start at h.start + k * len / missing
+		uint64_t k_base = 0, k_end = missing;
+		if (base > h.start)
+			k_base = ((base - h.start) * missing + len - 1) / len;
+		if (end < h.end)
+			k_end = ((end - h.start) * missing + len - 1) / len;
+		if (k_base > k_end) k_base = k_end;
+
+		uint64_t unblamed = kernel_drops_ - kernel_lost_;
+		uint64_t kernel = k_end < unblamed ? k_end : unblamed;
+		lost_packets_ += k_end;
+		kernel_lost_ += kernel;
+		if (info) {
+			info->lost_packets += k_end - k_base;
+			if (kernel > k_base) info->kernel_drops += kernel - k_base;
+		}
+
+		if (h.end <= end) {
+			memmove(&holes_[0], &holes_[1], (num_holes_ - 1) * sizeof(hole));
+			--num_holes_;
+		}
+		else {
+			h.seq_lo += k_end;
+			h.start = end;
+			break;
+		}
+	}
+}
+
+}
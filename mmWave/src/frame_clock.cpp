@@ -0,0 +1,169 @@
+#include "mmWave/frame_clock.h"
+
+#include <math.h>
+#include <algorithm>
+
+namespace mmwave
+{
+
+namespace
+{
+// a residual below this is never an outlier, the MAD of clean data is tiny
+const double MIN_THRESHOLD = 20000.0;	// ns
+}
+
+const size_t frame_clock::MIN_FRAMES;
+const int frame_clock::MAX_OUTLIER_RUN;
+
+frame_clock::frame_clock(double nominal_period, size_t window)
+	: nominal_(nominal_period), samples_(window < MIN_FRAMES ? MIN_FRAMES : window),
+	  head_(0), count_(0), outlier_run_(0), ref_index_(0), ref_stamp_(0), offset_(0), slope_(0),
+	  locked_(false), period_(nominal_period), drift_ppm_(0), jitter_(0), outliers_(0), resets_(0)
+{
+	scratch_.reserve(samples_.size());
+}
+
+void frame_clock::reset()
+{
+	head_ = 0;
+	count_ = 0;
+	outlier_run_ = 0;
+	locked_ = false;
+	period_ = nominal_;
+	drift_ppm_ = 0;
+	jitter_ = 0;
+}
+
+void frame_clock::add(uint64_t index, uint64_t stamp)
+{
+	if (count_ == samples_.size()) {
+		head_ = (head_ + 1) % samples_.size();
+		--count_;
+	}
+	sample& s = samples_[(head_ + count_++) % samples_.size()];
+	s.index = index;
+	s.stamp = stamp;
+	s.inlier = true;
+}
+
+// least squares line through the samples, ns from ref_stamp_ against frames from ref_index_
+bool frame_clock::fit(bool inliers_only, double& offset, double& slope) const
+{
+	double n = 0, sx = 0, sy = 0;
+	for (size_t i = 0; i < count_; ++i) {
+		const sample& s = samples_[(head_ + i) % samples_.size()];
+		if (inliers_only && !s.inlier) continue;
+		sx += (double)(s.index - ref_index_);
+		sy += (double)(int64_t)(s.stamp - ref_stamp_);
+		n += 1;
+	}
+	if (n < 2) return false;
+
+	// centred sums, the stamps are large
+	double mx = sx / n, my = sy / n, sxx = 0, sxy = 0;
+	for (size_t i = 0; i < count_; ++i) {
+		const sample& s = samples_[(head_ + i) % samples_.size()];
+		if (inliers_only && !s.inlier) continue;
+		double dx = (double)(s.index - ref_index_) - mx;
+		double dy = (double)(int64_t)(s.stamp - ref_stamp_) - my;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+	if (sxx <= 0) return false;
+	slope = sxy / sxx;
+	offset = my - slope * mx;
+	return true;
+}
+
+double frame_clock::residual(const sample& s, double offset, double slope) const
+{
+	return (double)(int64_t)(s.stamp - ref_stamp_) - (offset + slope * (double)(s.index - ref_index_));
+}
+
+// marks the samples further off the line than 3 sigma
+void frame_clock::reject(double offset, double slope)
+{
+	scratch_.clear();
+	for (size_t i = 0; i < count_; ++i) {
+		const sample& s = samples_[(head_ + i) % samples_.size()];
+		scratch_.push_back(fabs(residual(s, offset, slope)));
+	}
+	std::nth_element(scratch_.begin(), scratch_.begin() + scratch_.size() / 2, scratch_.end());
+	double sigma = 1.4826 * scratch_[scratch_.size() / 2];
+	double threshold = std::max(3 * sigma, MIN_THRESHOLD);
+
+	for (size_t i = 0; i < count_; ++i) {
+		sample& s = samples_[(head_ + i) % samples_.size()];
+		s.inlier = fabs(residual(s, offset, slope)) <= threshold;
+	}
+}
+
+uint64_t frame_clock::at(uint64_t index) const
+{
+	double t = offset_ + slope_ * ((double)index - (double)ref_index_);
+	return ref_stamp_ + (int64_t)llround(t);
+}
+
+uint64_t frame_clock::update(uint64_t index, uint64_t stamp)
+{
+	// all packets of the frame were lost, only the model knows when it was
+	if (stamp == 0) return locked_ ? at(index) : 0;
+
+	if (count_ > 0 && index <= samples_[(head_ + count_ - 1) % samples_.size()].index) {
+		reset();
+		++resets_;
+	}
+	add(index, stamp);
+	if (count_ < MIN_FRAMES) return stamp;
+
+	uint64_t last_index = ref_index_;
+	uint64_t last_stamp = ref_stamp_;
+	ref_index_ = samples_[head_].index;
+	ref_stamp_ = samples_[head_].stamp;
+	double offset, slope;
+	if (locked_) {
+		// outliers are judged against the last model moved to the new origin,
+		// a fit through them would tilt towards a step in the newest frames
+		slope = slope_;
+		offset = (double)(int64_t)(last_stamp - ref_stamp_) + offset_ + slope_ * (double)(ref_index_ - last_index);
+	}
+	else if (!fit(false, offset, slope)) {
+		return stamp;
+	}
+	reject(offset, slope);
+	fit(true, offset, slope);
+
+	const sample& newest = samples_[(head_ + count_ - 1) % samples_.size()];
+	if (!newest.inlier) {
+		++outliers_;
+		if (++outlier_run_ > MAX_OUTLIER_RUN) {
+			// the clock stepped, the old frames no longer fit
+			reset();
+			++resets_;
+			add(index, stamp);
+			return stamp;
+		}
+	}
+	else {
+		outlier_run_ = 0;
+	}
+
+	double sum = 0, n = 0;
+	for (size_t i = 0; i < count_; ++i) {
+		const sample& s = samples_[(head_ + i) % samples_.size()];
+		if (!s.inlier) continue;
+		double r = residual(s, offset, slope);
+		sum += r * r;
+		n += 1;
+	}
+
+	offset_ = offset;
+	slope_ = slope;
+	period_ = slope;
+	drift_ppm_ = nominal_ > 0 ? (slope / nominal_ - 1) * 1e6 : 0;
+	jitter_ = n > 0 ? sqrt(sum / n) : 0;
+	locked_ = true;
+	return at(index);
+}
+
+}
@@ -0,0 +1,58 @@
+#include "mmWave/frame_pool.h"
+#include "mmWave/circ_buff.h"
+
+#include <new>
+
+namespace mmwave
+{
+
+frame_pool::frame_pool(int64_t frame_len, int64_t num_slots, bool huge_pages)
+	: frame_len_(frame_len), num_slots_(num_slots), data_(NULL), page_mode_(RING_PAGES_NORMAL),
+	  info_(num_slots), refs_(new std::atomic<int>[num_slots]), cursor_(0)
+{
+	data_ = alloc_ring(frame_len * num_slots, huge_pages, &page_mode_);
+	if (!data_) throw std::bad_alloc();
+	for (int64_t i = 0; i < num_slots; ++i)
+		refs_[i].store(0, std::memory_order_relaxed);
+}
+
+frame_pool::~frame_pool()
+{
+	free_ring(data_, frame_len_ * num_slots_);
+}
+
+int64_t frame_pool::acquire()
+{
+	// round robin so slots are reused in ring order while the consumer keeps up
+	for (int64_t n = 0; n < num_slots_; ++n) {
+		int64_t slot = cursor_;
+		if (++cursor_ == num_slots_) cursor_ = 0;
+
+		// only the producer takes a free slot, a plain store is enough
+		if (refs_[slot].load(std::memory_order_acquire) == 0) {
+			refs_[slot].store(1, std::memory_order_relaxed);
+			return slot;
+		}
+	}
+	return -1;
+}
+
+void frame_pool::retain(int64_t slot)
+{
+	refs_[slot].fetch_add(1, std::memory_order_relaxed);
+}
+
+void frame_pool::release(int64_t slot)
+{
+	refs_[slot].fetch_sub(1, std::memory_order_release);
+}
+
+int64_t frame_pool::in_use() const
+{
+	int64_t n = 0;
+	for (int64_t i = 0; i < num_slots_; ++i)
+		if (refs_[i].load(std::memory_order_relaxed) != 0) ++n;
+	return n;
+}
+
+}
@@ -0,0 +1,114 @@
+#include "mmWave/frame_queue.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace mmwave
+{
+
+namespace
+{
+size_t round_up_pow2(size_t n)
+{
+	size_t r = 1;
+	while (r < n) r <<= 1;
+	return r;
+}
+}
+
+frame_queue::frame_queue(size_t capacity)
+	: slots_(round_up_pow2(capacity)), mask_(slots_.size() - 1),
+	  head_(0), tail_(0), sleeping_(false), high_water_(0)
+{
+	efd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (efd_ < 0) perror("frame_queue: eventfd");
+}
+
+frame_queue::~frame_queue()
+{
+	if (efd_ >= 0) close(efd_);
+}
+
+bool frame_queue::push(int64_t slot)
+{
+	size_t head = head_.load(std::memory_order_relaxed);
+	size_t tail = tail_.load(std::memory_order_acquire);
+	if (head - tail > mask_) return false;
+
+	slots_[head & mask_].store(slot, std::memory_order_relaxed);
+	head_.store(head + 1, std::memory_order_release);
+
+	size_t depth = head + 1 - tail;
+	if (depth > high_water_.load(std::memory_order_relaxed))
+		high_water_.store(depth, std::memory_order_relaxed);
+
+	// pairs with the fence in pop, either the consumer sees the new head or we see it sleeping
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load(std::memory_order_relaxed)) signal();
+	return true;
+}
+
+bool frame_queue::try_pop(int64_t& slot)
+{
+	size_t tail = tail_.load(std::memory_order_relaxed);
+	do {
+		if (tail == head_.load(std::memory_order_acquire)) return false;
+		// once steal moved tail the producer may be writing this entry again,
+		// the swap then fails and the value read is dropped
+		slot = slots_[tail & mask_].load(std::memory_order_relaxed);
+	} while (!tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_relaxed));
+	return true;
+}
+
+// same as try_pop, only the producer calls it so head does not move meanwhile
+bool frame_queue::steal(int64_t& slot)
+{
+	return try_pop(slot);
+}
+
+bool frame_queue::pop(int64_t& slot, int timeout_ms)
+{
+	if (try_pop(slot)) return true;
+
+	sleeping_.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (try_pop(slot)) {
+		sleeping_.store(false, std::memory_order_relaxed);
+		return true;
+	}
+
+	pollfd pfd;
+	pfd.fd = efd_;
+	pfd.events = POLLIN;
+	int r = poll(&pfd, 1, timeout_ms);
+	sleeping_.store(false, std::memory_order_relaxed);
+	if (r > 0) {
+		uint64_t count;
+		if (read(efd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+			perror("frame_queue: read");
+	}
+	return try_pop(slot);
+}
+
+// unblock a consumer sleeping in pop, e.g. on shutdown
+void frame_queue::wake()
+{
+	signal();
+}
+
+size_t frame_queue::depth() const
+{
+	return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+}
+
+void frame_queue::signal()
+{
+	uint64_t one = 1;
+	if (write(efd_, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		perror("frame_queue: write");
+}
+
+}
@@ -0,0 +1,274 @@
+#include "mmWave/iwr_cli.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace mmwave
+{
+
+namespace
+{
+typedef std::chrono::steady_clock clock_type;
+
+speed_t baud_rate(int baud)
+{
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 921600: return B921600;
+	}
+	return 0;
+}
+
+std::string trim(const std::string& s)
+{
+	size_t b = s.find_first_not_of(" \t\r\n");
+	if (b == std::string::npos) return std::string();
+	size_t e = s.find_last_not_of(" \t\r\n");
+	return s.substr(b, e - b + 1);
+}
+
+bool starts_with(const std::string& s, const char* prefix)
+{
+	return s.compare(0, strlen(prefix), prefix) == 0;
+}
+}
+
+const int iwr_cli::SYNC_TRIES;
+
+iwr_cli::iwr_cli() : fd_(-1), timeout_ms_(1000), error_code_(0)
+{
+}
+
+iwr_cli::~iwr_cli()
+{
+	close();
+}
+
+bool iwr_cli::open(const std::string& tty, int baud, const std::string& prompt)
+{
+	close();
+	prompt_ = prompt;
+	speed_t speed = baud_rate(baud);
+	if (speed == 0) {
+		error_ = "unsupported baud rate";
+		return false;
+	}
+	fd_ = ::open(tty.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd_ < 0) {
+		error_ = tty + ": " + strerror(errno);
+		return false;
+	}
+	termios t;
+	if (tcgetattr(fd_, &t) < 0) {
+		error_ = tty + ": " + strerror(errno);
+		close();
+		return false;
+	}
+	cfmakeraw(&t);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cflag &= ~(CSTOPB | CRTSCTS);
+	t.c_cc[VMIN] = 0;
+	t.c_cc[VTIME] = 0;
+	cfsetispeed(&t, speed);
+	cfsetospeed(&t, speed);
+	if (tcsetattr(fd_, TCSANOW, &t) < 0) {
+		error_ = tty + ": " + strerror(errno);
+		close();
+		return false;
+	}
+	return true;
+}
+
+void iwr_cli::close()
+{
+	if (fd_ >= 0) ::close(fd_);
+	fd_ = -1;
+}
+
+bool iwr_cli::sync()
+{
+	for (int i = 0; i < SYNC_TRIES; ++i)
+		if (write_line("") && read_prompt()) return true;
+	error_ = "no prompt from the radar, is it powered and flashed?";
+	return false;
+}
+
+bool iwr_cli::command(const std::string& line)
+{
+	error_code_ = 0;
+	error_.clear();
+	if (!write_line(line)) return false;
+	if (!read_prompt()) {
+		error_ = "'" + line + "': " + error_;
+		return false;
+	}
+	return check(line);
+}
+
+bool iwr_cli::configure(const std::vector<std::string>& lines)
+{
+	for (size_t i = 0; i < lines.size(); ++i) {
+		if (trim(lines[i]).empty()) continue;
+		if (!command(lines[i])) return false;
+	}
+	return true;
+}
+
+bool iwr_cli::write_line(const std::string& line)
+{
+	if (fd_ < 0) {
+		error_ = "not open";
+		return false;
+	}
+	// output of an earlier command or of the boot is not part of this answer
+	tcflush(fd_, TCIFLUSH);
+	response_.clear();
+
+	std::string out = line + "\r";
+	size_t done = 0;
+	while (done < out.size()) {
+		ssize_t r = write(fd_, out.data() + done, out.size() - done);
+		if (r < 0) {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN) {
+				error_ = std::string("write: ") + strerror(errno);
+				return false;
+			}
+			pollfd pfd;
+			pfd.fd = fd_;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, timeout_ms_);
+			continue;
+		}
+		done += r;
+	}
+	return true;
+}
+
+// reads into response_ until it ends with the prompt
+bool iwr_cli::read_prompt()
+{
+	clock_type::time_point deadline = clock_type::now() + std::chrono::milliseconds(timeout_ms_);
+	char buf[256];
+	for (;;) {
+		if (response_.size() >= prompt_.size() &&
+			response_.compare(response_.size() - prompt_.size(), prompt_.size(), prompt_) == 0) {
+			response_.resize(response_.size() - prompt_.size());
+			return true;
+		}
+
+		int wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_type::now()).count();
+		if (wait <= 0) {
+			char msg[64];
+			snprintf(msg, sizeof(msg), "no prompt within %d ms", timeout_ms_);
+			error_ = msg;
+			return false;
+		}
+		pollfd pfd;
+		pfd.fd = fd_;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, wait) <= 0) continue;
+		ssize_t r = read(fd_, buf, sizeof(buf));
+		if (r < 0 && errno != EAGAIN && errno != EINTR) {
+			error_ = std::string("read: ") + strerror(errno);
+			return false;
+		}
+		if (r > 0) response_.append(buf, r);
+	}
+}
+
+bool iwr_cli::check(const std::string& line)
+{
+	std::string cmd = trim(line);
+	std::string out, failure;
+	size_t pos = 0;
+	bool echo = true;
+	while (pos < response_.size()) {
+		size_t end = response_.find('\n', pos);
+		if (end == std::string::npos) end = response_.size();
+		std::string l = trim(response_.substr(pos, end - pos));
+		pos = end + 1;
+		if (l.empty()) continue;
+		if (echo && l == cmd) {
+			echo = false;
+			continue;
+		}
+		echo = false;
+		out += l + "\n";
+
+		if (starts_with(l, "Error")) {
+			// "Error <code>" closes a command, "Error: <text>" is the handler's explanation
+			char* end_code;
+			long code = strtol(l.c_str() + 5, &end_code, 10);
+			if (end_code != l.c_str() + 5) error_code_ = code;
+			failure += (failure.empty() ? "" : ", ") + l;
+		} else if (l.find("is not recognized as a CLI command") != std::string::npos) {
+			error_code_ = -1;
+			failure += (failure.empty() ? "" : ", ") + l;
+		}
+	}
+	response_ = out;
+	if (failure.empty()) return true;
+	error_ = "'" + cmd + "': " + failure;
+	return false;
+}
+
+}
+
+using mmwave::iwr_cli;
+
+void* iwr_cli_open(const char* tty, int baud, const char* prompt, int timeout_ms)
+{
+	iwr_cli* cli = new iwr_cli();
+	cli->set_timeout(timeout_ms);
+	if (!cli->open(tty, baud, prompt)) {
+		fprintf(stderr, "iwr_cli: %s\n", cli->error().c_str());
+		delete cli;
+		return NULL;
+	}
+	return cli;
+}
+
+void iwr_cli_close(void* cli)
+{
+	delete (iwr_cli*)cli;
+}
+
+int iwr_cli_sync(void* cli)
+{
+	return ((iwr_cli*)cli)->sync();
+}
+
+int iwr_cli_command(void* cli, const char* line)
+{
+	return ((iwr_cli*)cli)->command(line);
+}
+
+const char* iwr_cli_response(void* cli)
+{
+	return ((iwr_cli*)cli)->response().c_str();
+}
+
+int iwr_cli_error_code(void* cli)
+{
+	return ((iwr_cli*)cli)->error_code();
+}
+
+const char* iwr_cli_error(void* cli)
+{
+	return ((iwr_cli*)cli)->error().c_str();
+}
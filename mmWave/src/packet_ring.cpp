@@ -0,0 +1,226 @@
+#include "mmWave/packet_ring.h"
+
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mmwave
+{
+
+namespace
+{
+const size_t ETH_HEADER_LEN = 14;
+const size_t UDP_HEADER_LEN = 8;
+const unsigned FRAME_SIZE = 2048;	// a DCA1000 datagram fits in one
+const unsigned BLOCK_TIMEOUT_MS = 2;	// hand over partly filled blocks, blocks arrive in bursts
+}
+
+std::string interface_of(const std::string& addr)
+{
+	in_addr a;
+	if (inet_pton(AF_INET, addr.c_str(), &a) != 1) return std::string();
+
+	ifaddrs* ifs;
+	if (getifaddrs(&ifs) < 0) return std::string();
+	std::string name;
+	for (ifaddrs* i = ifs; i; i = i->ifa_next) {
+		if (!i->ifa_addr || i->ifa_addr->sa_family != AF_INET) continue;
+		if (((sockaddr_in*)i->ifa_addr)->sin_addr.s_addr == a.s_addr) {
+			name = i->ifa_name;
+			break;
+		}
+	}
+	freeifaddrs(ifs);
+	return name;
+}
+
+packet_ring::packet_ring()
+	: fd_(-1), map_(NULL), map_len_(0), block_size_(0), num_blocks_(0),
+	  block_(0), desc_(NULL), pkt_(NULL), pkts_left_(0), drops_(0)
+{
+}
+
+packet_ring::~packet_ring()
+{
+	close();
+}
+
+bool packet_ring::open(const std::string& interface, const std::string& addr, uint16_t port,
+					   size_t block_size, size_t num_blocks)
+{
+	std::string ifname = interface.empty() ? interface_of(addr) : interface;
+	unsigned ifindex = ifname.empty() ? 0 : if_nametoindex(ifname.c_str());
+	if (ifindex == 0) {
+		fprintf(stderr, "packet_ring: no interface for %s\n", addr.c_str());
+		return false;
+	}
+	in_addr a;
+	if (inet_pton(AF_INET, addr.c_str(), &a) != 1) {
+		fprintf(stderr, "packet_ring: invalid address %s\n", addr.c_str());
+		return false;
+	}
+
+	// protocol 0 receives nothing until bind, so no packet gets past the filter
+	fd_ = socket(AF_PACKET, SOCK_RAW, 0);
+	if (fd_ < 0) {
+		perror("packet_ring: socket");
+		return false;
+	}
+	if (!attach_filter(ntohl(a.s_addr), port)) return false;
+
+	int version = TPACKET_V3;
+	if (setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+		perror("packet_ring: PACKET_VERSION");
+		return false;
+	}
+
+	tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = block_size;
+	req.tp_block_nr = num_blocks;
+	req.tp_frame_size = FRAME_SIZE;
+	req.tp_frame_nr = block_size / FRAME_SIZE * num_blocks;
+	req.tp_retire_blk_tov = BLOCK_TIMEOUT_MS;
+	if (setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+		perror("packet_ring: PACKET_RX_RING");
+		return false;
+	}
+
+	map_len_ = block_size * num_blocks;
+	void* map = mmap(NULL, map_len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	if (map == MAP_FAILED) {
+		perror("packet_ring: mmap");
+		map_len_ = 0;
+		return false;
+	}
+	map_ = (uint8_t*)map;
+	block_size_ = block_size;
+	num_blocks_ = num_blocks;
+
+	sockaddr_ll ll;
+	memset(&ll, 0, sizeof(ll));
+	ll.sll_family = AF_PACKET;
+	ll.sll_protocol = htons(ETH_P_IP);
+	ll.sll_ifindex = ifindex;
+	if (bind(fd_, (sockaddr*)&ll, sizeof(ll)) < 0) {
+		perror("packet_ring: bind");
+		return false;
+	}
+	return true;
+}
+
+void packet_ring::close()
+{
+	if (map_) munmap(map_, map_len_);
+	map_ = NULL;
+	map_len_ = 0;
+	desc_ = NULL;
+	if (fd_ >= 0) ::close(fd_);
+	fd_ = -1;
+}
+
+// accept incoming IPv4 UDP to addr:port that is not a fragment, addr in host order
+bool packet_ring::attach_filter(uint32_t addr, uint16_t port)
+{
+	sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_PKTTYPE)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 12, 0),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),				// ethertype
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 0, 10),
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),				// ip protocol
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 8),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 30),				// ip destination
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, addr, 0, 6),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),				// fragment offset
+		BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+		BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),			// ip header length
+		BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),				// udp destination port
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	sock_fprog prog;
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if (setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0) {
+		perror("packet_ring: SO_ATTACH_FILTER");
+		return false;
+	}
+	return true;
+}
+
+// the kernel resets the counters on every read
+void packet_ring::read_stats()
+{
+	tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+	if (getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0)
+		drops_ += st.tp_drops;
+}
+
+void packet_ring::release_block()
+{
+	__sync_synchronize();
+	desc_->hdr.bh1.block_status = TP_STATUS_KERNEL;
+	desc_ = NULL;
+	block_ = (block_ + 1) % num_blocks_;
+}
+
+const uint8_t* packet_ring::next_datagram(unsigned& len, uint64_t& stamp, int timeout_ms)
+{
+	if (!map_) return NULL;
+
+	for (;;) {
+		if (desc_ && pkts_left_ == 0) release_block();
+
+		if (!desc_) {
+			tpacket_block_desc* desc = (tpacket_block_desc*)(map_ + block_ * block_size_);
+			if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+				if (timeout_ms == 0) return NULL;
+				pollfd pfd;
+				pfd.fd = fd_;
+				pfd.events = POLLIN | POLLERR;
+				pfd.revents = 0;
+				if (poll(&pfd, 1, timeout_ms) <= 0) {
+					read_stats();
+					return NULL;
+				}
+				timeout_ms = 0;
+				continue;
+			}
+			desc_ = desc;
+			read_stats();
+			pkt_ = (tpacket3_hdr*)((uint8_t*)desc + desc->hdr.bh1.offset_to_first_pkt);
+			pkts_left_ = desc->hdr.bh1.num_pkts;
+			continue;
+		}
+
+		tpacket3_hdr* pkt = pkt_;
+		pkt_ = (tpacket3_hdr*)((uint8_t*)pkt + pkt->tp_next_offset);
+		--pkts_left_;
+
+		// the filter already checked protocol, address and port
+		const uint8_t* eth = (const uint8_t*)pkt + pkt->tp_mac;
+		size_t ip_len = (eth[ETH_HEADER_LEN] & 0xf) * 4;
+		size_t headers = ETH_HEADER_LEN + ip_len + UDP_HEADER_LEN;
+		if (pkt->tp_snaplen < headers) continue;
+		const uint8_t* udp = eth + ETH_HEADER_LEN + ip_len;
+		unsigned udp_len = (udp[4] << 8 | udp[5]) - UDP_HEADER_LEN;
+		len = pkt->tp_snaplen - headers;
+		if (udp_len < len) len = udp_len;	// ethernet padding
+		stamp = pkt->tp_sec * 1000000000ULL + pkt->tp_nsec;
+		return udp + UDP_HEADER_LEN;
+	}
+}
+
+}
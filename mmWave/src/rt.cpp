@@ -0,0 +1,118 @@
+#include "mmWave/rt.h"
+
+#include <alloca.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+namespace mmwave
+{
+
+namespace
+{
+// cpu in a kernel cpu list such as "2-3,6", as in /sys/devices/system/cpu/isolated
+bool in_cpu_list(const std::string& list, int cpu)
+{
+	const char* p = list.c_str();
+	while (*p) {
+		char* end;
+		long lo = strtol(p, &end, 10);
+		if (end == p) break;
+		long hi = lo;
+		p = end;
+		if (*p == '-') {
+			hi = strtol(p + 1, &end, 10);
+			p = end;
+		}
+		if (cpu >= lo && cpu <= hi) return true;
+		while (*p == ',' || *p == '\n' || *p == ' ') ++p;
+	}
+	return false;
+}
+
+std::string read_line(const char* path)
+{
+	std::ifstream f(path);
+	std::string line;
+	std::getline(f, line);
+	return line;
+}
+}
+
+bool pin_thread(int cpu)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err) {
+		fprintf(stderr, "WARN: unable to pin the capture thread to cpu %d: %s\n", cpu, strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool set_fifo(int priority)
+{
+	sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (err) {
+		fprintf(stderr, "WARN: unable to set SCHED_FIFO priority %d: %s (needs CAP_SYS_NICE or rtprio in limits.conf)\n",
+				priority, strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool lock_memory()
+{
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		fprintf(stderr, "WARN: mlockall: %s (needs CAP_IPC_LOCK or memlock in limits.conf)\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+void prefault(void* addr, size_t len)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	volatile char* p = (volatile char*)addr;
+	for (size_t off = 0; off < len; off += page) p[off] = p[off];
+	if (len) p[len - 1] = p[len - 1];
+}
+
+void prefault_stack(size_t bytes)
+{
+	volatile char* stack = (volatile char*)alloca(bytes);
+	long page = sysconf(_SC_PAGESIZE);
+	for (size_t off = 0; off < bytes; off += page) stack[off] = 0;
+}
+
+bool check_isolated(int cpu)
+{
+	long num_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (cpu < 0 || cpu >= num_cpus) {
+		fprintf(stderr, "WARN: cpu %d does not exist, the host has %ld\n", cpu, num_cpus);
+		return false;
+	}
+
+	bool isolated = in_cpu_list(read_line("/sys/devices/system/cpu/isolated"), cpu);
+	if (!isolated)
+		fprintf(stderr, "WARN: cpu %d is not isolated, other tasks will be scheduled on it (boot with isolcpus=%d)\n",
+				cpu, cpu);
+	if (!in_cpu_list(read_line("/sys/devices/system/cpu/nohz_full"), cpu))
+		fprintf(stderr, "WARN: cpu %d still gets the scheduler tick (boot with nohz_full=%d)\n", cpu, cpu);
+	return isolated;
+}
+
+}
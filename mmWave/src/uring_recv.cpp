@@ -0,0 +1,323 @@
+#include "mmWave/uring_recv.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace mmwave
+{
+
+namespace
+{
+const uint16_t BUF_GROUP = 0;
+const uint64_t RECV_TAG = 1;
+const unsigned CONTROL_LEN = 64;	// SO_TIMESTAMPNS and SO_RXQ_OVFL
+
+int io_uring_setup(unsigned entries, io_uring_params* p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+unsigned load_acquire(const unsigned* p)
+{
+	return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned* p, unsigned v)
+{
+	__atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+}
+
+uring_recv::uring_recv()
+	: ring_fd_(-1), sock_fd_(-1), sq_map_(NULL), sq_map_len_(0), cq_map_(NULL), cq_map_len_(0),
+	  sqes_(NULL), sqes_len_(0), sq_head_(NULL), sq_tail_(NULL), sq_mask_(NULL), sq_array_(NULL),
+	  cq_head_(NULL), cq_tail_(NULL), cq_mask_(NULL), cqes_(NULL),
+	  buf_ring_(NULL), buf_ring_len_(0), bufs_(NULL), num_bufs_(0), buf_len_(0), buf_tail_(0),
+	  socket_drops_(0), truncated_(0), armed_(false), failed_(false), to_submit_(0), held_(-1)
+{
+	memset(&msg_, 0, sizeof(msg_));
+	msg_.msg_controllen = CONTROL_LEN;
+}
+
+uring_recv::~uring_recv()
+{
+	close();
+}
+
+bool uring_recv::open(int fd, unsigned num_bufs, unsigned buf_len)
+{
+	sock_fd_ = fd;
+	num_bufs_ = 1;
+	while (num_bufs_ < num_bufs) num_bufs_ <<= 1;
+	// recvmsg puts its own header and the control messages in front of the payload
+	buf_len_ = sizeof(io_uring_recvmsg_out) + CONTROL_LEN + buf_len;
+
+	// one recv in flight, but room for a completion per buffer
+	io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 2 * num_bufs_;
+	ring_fd_ = io_uring_setup(4, &p);
+	if (ring_fd_ < 0) {
+		perror("uring_recv: io_uring_setup");
+		return false;
+	}
+
+	sq_map_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_map_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_map_len_ > sq_map_len_) sq_map_len_ = cq_map_len_;
+		cq_map_len_ = 0;
+	}
+	sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+	if (!map_rings()) return false;
+
+	uint8_t* sq = (uint8_t*)sq_map_;
+	uint8_t* cq = (uint8_t*)(cq_map_ ? cq_map_ : sq_map_);
+	sq_head_ = (unsigned*)(sq + p.sq_off.head);
+	sq_tail_ = (unsigned*)(sq + p.sq_off.tail);
+	sq_mask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+	sq_array_ = (unsigned*)(sq + p.sq_off.array);
+	cq_head_ = (unsigned*)(cq + p.cq_off.head);
+	cq_tail_ = (unsigned*)(cq + p.cq_off.tail);
+	cq_mask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+	cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+
+	return setup_buffers() && probe();
+}
+
+// arm the recvmsg now, an opcode or flag the kernel does not know fails at
+// submission and its completion is already there when enter returns
+bool uring_recv::probe()
+{
+	failed_ = false;
+	arm();
+	if (enter(to_submit_, 0, 0) < 0) return false;
+	unsigned head = *cq_head_;
+	if (head == load_acquire(cq_tail_)) return true;
+	const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+	if (cqe.user_data != RECV_TAG || cqe.res >= 0 || cqe.res == -ENOBUFS) return true;
+	fprintf(stderr, "uring_recv: multishot recvmsg: %s, needs Linux 6.0\n", strerror(-cqe.res));
+	return false;
+}
+
+bool uring_recv::map_rings()
+{
+	sq_map_ = mmap(NULL, sq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				   ring_fd_, IORING_OFF_SQ_RING);
+	if (sq_map_ == MAP_FAILED) {
+		sq_map_ = NULL;
+		perror("uring_recv: mmap sq");
+		return false;
+	}
+	if (cq_map_len_) {
+		cq_map_ = mmap(NULL, cq_map_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					   ring_fd_, IORING_OFF_CQ_RING);
+		if (cq_map_ == MAP_FAILED) {
+			cq_map_ = NULL;
+			perror("uring_recv: mmap cq");
+			return false;
+		}
+	}
+	void* sqes = mmap(NULL, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					  ring_fd_, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED) {
+		perror("uring_recv: mmap sqes");
+		return false;
+	}
+	sqes_ = (io_uring_sqe*)sqes;
+	return true;
+}
+
+bool uring_recv::setup_buffers()
+{
+	buf_ring_len_ = num_bufs_ * sizeof(io_uring_buf);
+	void* ring = mmap(NULL, buf_ring_len_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	void* bufs = mmap(NULL, (size_t)num_bufs_ * buf_len_, PROT_READ | PROT_WRITE,
+					  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (ring == MAP_FAILED || bufs == MAP_FAILED) {
+		perror("uring_recv: mmap buffers");
+		if (ring != MAP_FAILED) munmap(ring, buf_ring_len_);
+		if (bufs != MAP_FAILED) munmap(bufs, (size_t)num_bufs_ * buf_len_);
+		return false;
+	}
+	buf_ring_ = (io_uring_buf_ring*)ring;
+	bufs_ = (uint8_t*)bufs;
+
+	io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)buf_ring_;
+	reg.ring_entries = num_bufs_;
+	reg.bgid = BUF_GROUP;
+	if (io_uring_register(ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		perror("uring_recv: IORING_REGISTER_PBUF_RING");
+		return false;
+	}
+
+	buf_tail_ = 0;
+	for (unsigned bid = 0; bid < num_bufs_; ++bid) recycle(bid);
+	return true;
+}
+
+void uring_recv::close()
+{
+	if (sqes_) munmap(sqes_, sqes_len_);
+	if (cq_map_) munmap(cq_map_, cq_map_len_);
+	if (sq_map_) munmap(sq_map_, sq_map_len_);
+	sqes_ = NULL;
+	cq_map_ = NULL;
+	sq_map_ = NULL;
+	// the buffer ring is unregistered with the io_uring instance
+	if (ring_fd_ >= 0) ::close(ring_fd_);
+	ring_fd_ = -1;
+	if (buf_ring_) munmap(buf_ring_, buf_ring_len_);
+	if (bufs_) munmap(bufs_, (size_t)num_bufs_ * buf_len_);
+	buf_ring_ = NULL;
+	bufs_ = NULL;
+	armed_ = false;
+	to_submit_ = 0;
+	held_ = -1;
+}
+
+// hand buffer bid back to the kernel
+void uring_recv::recycle(unsigned bid)
+{
+	// not buf_ring_->bufs, the flexible array member sits 8 bytes off in C++
+	io_uring_buf* buf = (io_uring_buf*)buf_ring_ + (buf_tail_ & (num_bufs_ - 1));
+	buf->addr = (uint64_t)(uintptr_t)(bufs_ + (size_t)bid * buf_len_);
+	buf->len = buf_len_;
+	buf->bid = bid;
+	++buf_tail_;
+	__atomic_store_n(&buf_ring_->tail, buf_tail_, __ATOMIC_RELEASE);
+}
+
+// queue the multishot recvmsg, submitted by the next enter
+void uring_recv::arm()
+{
+	unsigned tail = *sq_tail_;
+	unsigned idx = tail & *sq_mask_;
+	io_uring_sqe* sqe = &sqes_[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sock_fd_;
+	sqe->addr = (uint64_t)(uintptr_t)&msg_;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUF_GROUP;
+	sqe->user_data = RECV_TAG;
+	sq_array_[idx] = idx;
+	store_release(sq_tail_, tail + 1);
+	++to_submit_;
+	armed_ = true;
+}
+
+// submit queued entries and wait up to timeout_ms for a completion, -1 on error
+int uring_recv::enter(unsigned to_submit, unsigned min_complete, int timeout_ms)
+{
+	__kernel_timespec ts;
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+	io_uring_getevents_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uint64_t)(uintptr_t)&ts;
+
+	unsigned flags = IORING_ENTER_EXT_ARG;
+	if (min_complete) flags |= IORING_ENTER_GETEVENTS;
+	int ret = io_uring_enter(ring_fd_, to_submit, min_complete, flags, &arg, sizeof(arg));
+	if (ret < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+		perror("uring_recv: io_uring_enter");
+		return -1;
+	}
+	if (ret > 0) to_submit_ -= ret < (int)to_submit ? ret : to_submit;
+	return ret;
+}
+
+const uint8_t* uring_recv::next_datagram(unsigned& len, uint64_t& stamp, int timeout_ms)
+{
+	if (ring_fd_ < 0 || failed_) return NULL;
+	if (held_ >= 0) {
+		recycle(held_);
+		held_ = -1;
+	}
+
+	for (;;) {
+		unsigned head = *cq_head_;
+		if (head == load_acquire(cq_tail_)) {
+			// the recvmsg stops when it ran out of buffers, start it again
+			if (!armed_) arm();
+			if (timeout_ms == 0 && to_submit_ == 0) return NULL;
+			if (enter(to_submit_, timeout_ms ? 1 : 0, timeout_ms) < 0) return NULL;
+			if (head == load_acquire(cq_tail_)) {
+				if (timeout_ms == 0) return NULL;
+				timeout_ms = 0;
+			}
+			continue;
+		}
+
+		io_uring_cqe cqe = cqes_[head & *cq_mask_];
+		store_release(cq_head_, head + 1);
+		if (cqe.user_data != RECV_TAG) continue;
+		if (!(cqe.flags & IORING_CQE_F_MORE)) armed_ = false;
+		if (cqe.res == -ENOBUFS) continue;
+		if (cqe.res < 0) {
+			fprintf(stderr, "uring_recv: recv: %s\n", strerror(-cqe.res));
+			// the kernel will refuse it again, re-arming would only spin
+			if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) failed_ = true;
+			return NULL;
+		}
+		if (!(cqe.flags & IORING_CQE_F_BUFFER)) continue;
+
+		held_ = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+		uint8_t* buf = bufs_ + (size_t)held_ * buf_len_;
+		const io_uring_recvmsg_out* out = (const io_uring_recvmsg_out*)buf;
+		if (out->flags & MSG_TRUNC) {
+			++truncated_;
+			recycle(held_);
+			held_ = -1;
+			continue;
+		}
+		// room in the buffer is laid out by the template, not by what was received
+		uint8_t* control = buf + sizeof(*out) + msg_.msg_namelen;
+		uint8_t* payload = control + msg_.msg_controllen;
+
+		msghdr mh;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_control = control;
+		mh.msg_controllen = out->controllen;
+		stamp = 0;
+		for (cmsghdr* c = CMSG_FIRSTHDR(&mh); c; c = CMSG_NXTHDR(&mh, c)) {
+			if (c->cmsg_level != SOL_SOCKET) continue;
+			if (c->cmsg_type == SCM_TIMESTAMPNS) {
+				timespec ts;
+				memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+				stamp = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+			}
+			else if (c->cmsg_type == SO_RXQ_OVFL) {
+				memcpy(&socket_drops_, CMSG_DATA(c), sizeof(socket_drops_));
+			}
+		}
+		len = out->payloadlen;
+		return payload;
+	}
+}
+
+}
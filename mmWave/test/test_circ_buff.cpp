@@ -0,0 +1,232 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/circ_buff.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <vector>
+
+namespace
+{
+
+// frames past 2^31 samples, a ring of two of them is 8 GiB
+const int64_t HUGE_FRAME = (1LL << 31) + 4096;
+
+/*
+	Ring too large to allocate, mapped without reserving memory so only the pages
+	a test touches are backed.
+*/
+class sparse_ring
+{
+public:
+	explicit sparse_ring(int64_t len) : len_(len)
+	{
+		void* p = mmap(NULL, bytes(), PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		data_ = p == MAP_FAILED ? NULL : (int16_t*)p;
+	}
+	~sparse_ring()
+	{
+		if (data_) munmap(data_, bytes());
+	}
+
+	int16_t* data() { return data_; }
+
+private:
+	size_t bytes() const { return (size_t)len_ * sizeof(int16_t); }
+
+	int64_t len_;
+	int16_t* data_;
+};
+
+std::vector<int16_t> ramp(int64_t len, int16_t first)
+{
+	std::vector<int16_t> v(len);
+	for (int64_t i = 0; i < len; ++i) v[i] = (int16_t)(first + i);
+	return v;
+}
+
+// one DCA1000 datagram, 10 byte header and payload
+std::vector<uint8_t> datagram(uint32_t seqn, int64_t bytec, const std::vector<int16_t>& payload)
+{
+	std::vector<uint8_t> d(10 + payload.size() * sizeof(int16_t));
+	memcpy(&d[0], &seqn, 4);
+	for (int i = 0; i < 6; ++i) d[4 + i] = (uint8_t)(bytec >> (8 * i));
+	memcpy(&d[10], &payload[0], payload.size() * sizeof(int16_t));
+	return d;
+}
+
+// whole datagrams back to back as recv puts them in the python ring
+std::vector<uint8_t> batch(const std::vector<std::vector<uint8_t> >& dgrams)
+{
+	std::vector<uint8_t> pkts;
+	for (size_t i = 0; i < dgrams.size(); ++i) pkts.insert(pkts.end(), dgrams[i].begin(), dgrams[i].end());
+	return pkts;
+}
+
+}
+
+TEST(CircBuff, MessageLongerThanInt16WrapsAround)
+{
+	const int64_t frame = 50000, len = 2 * frame;
+	std::vector<int16_t> buf(len, -1);
+	std::vector<int16_t> msg = ramp(40000, 1);
+	int64_t put = 80000, pop = -1;
+
+	add_msg(&msg[0], (int64_t)msg.size(), &buf[0], len, &put, frame, &pop);
+
+	EXPECT_EQ(20000, put);
+	EXPECT_EQ(1, pop);
+	EXPECT_EQ(1, buf[80000]);
+	EXPECT_EQ(msg[19999], buf[len - 1]);
+	EXPECT_EQ(msg[20000], buf[0]);
+	EXPECT_EQ(msg[39999], buf[19999]);
+	EXPECT_EQ(-1, buf[20000]);
+}
+
+TEST(CircBuff, ByteCountIs48Bit)
+{
+	std::vector<int16_t> payload(1, 0);
+	std::vector<uint8_t> d = datagram(7, 0xABCDEF012345LL, payload);
+	EXPECT_EQ(0xABCDEF012345LL, dca_byte_count(&d[0]));
+	EXPECT_EQ(7, dca_seqn(&d[0]));
+}
+
+TEST(CircBuff, HugeFrameMessageCrossesFrameAndRingEnd)
+{
+	const int64_t len = 2 * HUGE_FRAME;
+	sparse_ring ring(len);
+	ASSERT_TRUE(ring.data() != NULL);
+	int16_t* buf = ring.data();
+	std::vector<int16_t> msg = ramp(1456, 100);
+
+	// end of frame 0, past the int32 range
+	int64_t put = HUGE_FRAME - 100, pop = -1;
+	add_msg(&msg[0], (int64_t)msg.size(), buf, len, &put, HUGE_FRAME, &pop);
+	EXPECT_EQ(HUGE_FRAME + 1356, put);
+	EXPECT_EQ(0, pop);
+	EXPECT_EQ(msg[99], buf[HUGE_FRAME - 1]);
+	EXPECT_EQ(msg[100], buf[HUGE_FRAME]);
+
+	// end of the ring
+	put = len - 500;
+	add_msg(&msg[0], (int64_t)msg.size(), buf, len, &put, HUGE_FRAME, &pop);
+	EXPECT_EQ(956, put);
+	EXPECT_EQ(1, pop);
+	EXPECT_EQ(msg[0], buf[len - 500]);
+	EXPECT_EQ(msg[499], buf[len - 1]);
+	EXPECT_EQ(msg[500], buf[0]);
+	EXPECT_EQ(msg[1455], buf[955]);
+}
+
+TEST(CircBuff, HugeZeroFillSkipsWholeFrames)
+{
+	const int64_t len = 2 * HUGE_FRAME;
+	sparse_ring ring(len);
+	ASSERT_TRUE(ring.data() != NULL);
+	int16_t* buf = ring.data();
+	buf[len - 10] = 1;
+	buf[0] = 1;
+	buf[30] = 1;
+
+	// 10 samples to the end of the ring, 3 whole frames skipped, 30 into frame 0
+	int64_t put = len - 10, pop = -1;
+	int64_t num_zeros = 10 + 3 * HUGE_FRAME + 30;
+	EXPECT_EQ(40, zeros_advance(num_zeros, put, HUGE_FRAME));
+	add_zeros(num_zeros, buf, len, &put, HUGE_FRAME, &pop);
+	EXPECT_EQ(30, put);
+	EXPECT_EQ(1, pop);
+	EXPECT_EQ(0, buf[len - 10]);
+	EXPECT_EQ(0, buf[0]);
+	EXPECT_EQ(1, buf[30]);
+}
+
+TEST(CircBuff, ResyncBeyond4GiB)
+{
+	const int64_t len = 2 * HUGE_FRAME, payload = 728;
+	sparse_ring ring(len);
+	ASSERT_TRUE(ring.data() != NULL);
+	int16_t* buf = ring.data();
+	int64_t infos[2 * FRAME_INFO_LEN];
+	clear_frame_infos(infos, 2);
+	buf[499] = 1;
+
+	// joined 3 frames and 500 samples into the stream
+	int64_t first = 3 * HUGE_FRAME + 500;
+	std::vector<std::vector<uint8_t> > dgrams(1, datagram(5, first * 2, ramp(payload, 1)));
+	std::vector<uint8_t> pkts = batch(dgrams);
+	int64_t msg_len = payload;
+
+	int64_t bytec = -1, seqn = -1, added = 0, resyncs = 0, put = 0;
+	int64_t pops[2];
+	int64_t num_pops = pad_and_add_msgs(&bytec, &seqn, &pkts[0], 10 + payload * 2, (int16_t*)&pkts[10],
+										&msg_len, 5 + payload, 1, &added,
+										buf, len, &put, HUGE_FRAME, pops, infos, &resyncs);
+
+	EXPECT_EQ(0, num_pops);
+	EXPECT_EQ(1, added);
+	EXPECT_EQ(0, resyncs);	// the first packet is not a restart
+	EXPECT_EQ(500 + payload, put);
+	EXPECT_EQ((first + payload) * 2, bytec);
+	EXPECT_EQ(0, buf[499]);
+	EXPECT_EQ(1, buf[500]);
+	EXPECT_EQ(1, infos[INFO_PACKETS]);
+	EXPECT_EQ(500, infos[INFO_ZERO_FILLED]);
+}
+
+TEST(CircBuff, BatchGapCrossesHugeFrame)
+{
+	const int64_t len = 2 * HUGE_FRAME, payload = 728;
+	sparse_ring ring(len);
+	ASSERT_TRUE(ring.data() != NULL);
+	int16_t* buf = ring.data();
+	int64_t infos[2 * FRAME_INFO_LEN];
+	clear_frame_infos(infos, 2);
+
+	// the stream continues 1000 samples before the end of its 4th frame, past 2^32 bytes
+	int64_t first = 4 * HUGE_FRAME - 1000;
+	std::vector<std::vector<uint8_t> > dgrams;
+	for (uint32_t k = 0; k < 4; ++k) {
+		if (k == 1) continue;	// lost, its gap crosses the frame boundary
+		dgrams.push_back(datagram(10 + k, (first + k * payload) * 2, ramp(payload, (int16_t)(k + 1))));
+	}
+	std::vector<uint8_t> pkts = batch(dgrams);
+	std::vector<int64_t> msg_lens(dgrams.size(), payload);
+
+	int64_t bytec = first * 2, seqn = 9, added = 0, resyncs = 0, put = HUGE_FRAME - 1000;
+	int64_t pops[6];
+	int64_t stride = 10 + payload * 2;
+	int64_t num_pops = pad_and_add_msgs(&bytec, &seqn, &pkts[0], stride, (int16_t*)&pkts[10],
+										&msg_lens[0], stride / 2, (int64_t)dgrams.size(), &added,
+										buf, len, &put, HUGE_FRAME, pops, infos, &resyncs);
+
+	EXPECT_EQ(3, added);
+	EXPECT_EQ(0, resyncs);
+	ASSERT_EQ(1, num_pops);
+	EXPECT_EQ(0, pops[0]);
+	EXPECT_EQ((first + 4 * payload) * 2, bytec);
+	EXPECT_EQ(13, seqn);
+	EXPECT_EQ(HUGE_FRAME + 4 * payload - 1000, put);
+
+	EXPECT_EQ(1, buf[HUGE_FRAME - 1000]);
+	EXPECT_EQ(0, buf[HUGE_FRAME - 1000 + payload]);
+	EXPECT_EQ(0, buf[HUGE_FRAME]);
+	EXPECT_EQ(0, buf[HUGE_FRAME - 1001 + 2 * payload]);
+	EXPECT_EQ(3, buf[HUGE_FRAME - 1000 + 2 * payload]);
+	EXPECT_EQ(4, buf[HUGE_FRAME - 1000 + 3 * payload]);
+
+	// packet 10 and the gap of 11 start in frame 0, 12 and 13 in frame 1
+	const int64_t* info = infos;
+	EXPECT_EQ(1, info[INFO_PACKETS]);
+	EXPECT_EQ(1, info[INFO_LOST]);
+	EXPECT_EQ(1000 - payload, info[INFO_ZERO_FILLED]);
+	EXPECT_EQ(10, info[INFO_FIRST_SEQ]);
+	EXPECT_EQ(10, info[INFO_LAST_SEQ]);
+	info = infos + FRAME_INFO_LEN;
+	EXPECT_EQ(2, info[INFO_PACKETS]);
+	EXPECT_EQ(0, info[INFO_LOST]);
+	EXPECT_EQ(2 * payload - 1000, info[INFO_ZERO_FILLED]);
+	EXPECT_EQ(12, info[INFO_FIRST_SEQ]);
+	EXPECT_EQ(13, info[INFO_LAST_SEQ]);
+}
@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/dca1000.h"
+#include "mmWave/dca1000_control.h"
+#include "mmWave/dca1000_emulator.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using mmwave::dca_header;
+using mmwave::dca_impairments;
+using mmwave::dca_streamer;
+using mmwave::parse_dca_header;
+
+namespace
+{
+
+struct datagram
+{
+	dca_header header;
+	std::vector<uint8_t> payload;
+};
+
+// datagrams waiting on fd
+std::vector<datagram> drain(int fd)
+{
+	std::vector<datagram> r;
+	uint8_t buf[mmwave::DCA_MAX_PACKET];
+	ssize_t len;
+	while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+		datagram d;
+		d.header = parse_dca_header(buf);
+		d.payload.assign(buf + mmwave::DCA_HEADER_LEN, buf + len);
+		r.push_back(d);
+	}
+	return r;
+}
+
+}
+
+TEST(DcaStreamer, CutsTheStreamIntoDcaPackets)
+{
+	int sv[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, sv));
+	dca_streamer s(sv[0], dca_impairments());
+	std::vector<uint8_t> first(4000, 1), second(4000, 2);
+
+	ASSERT_TRUE(s.send_frame(&first[0], first.size()));
+	ASSERT_TRUE(s.send_frame(&second[0], second.size()));
+	EXPECT_EQ(8000u, s.bytes());
+	std::vector<datagram> p = drain(sv[1]);
+	// full packets only, the third one straddles the frames
+	ASSERT_EQ(5u, p.size());
+	EXPECT_EQ(1u, p[0].header.seqn);
+	EXPECT_EQ(1456u, p[1].header.bytec);
+	EXPECT_EQ(3u, p[2].header.seqn);
+	EXPECT_EQ(2912u, p[2].header.bytec);
+	ASSERT_EQ(1456u, p[2].payload.size());
+	EXPECT_EQ(1, p[2].payload[4000 - 2912 - 1]);
+	EXPECT_EQ(2, p[2].payload[4000 - 2912]);
+	EXPECT_EQ(1456u, p[4].payload.size());
+
+	// the end of the recording is the short one
+	ASSERT_TRUE(s.finish());
+	p = drain(sv[1]);
+	ASSERT_EQ(1u, p.size());
+	EXPECT_EQ(6u, p[0].header.seqn);
+	EXPECT_EQ(5 * 1456u, p[0].header.bytec);
+	EXPECT_EQ(8000u - 5 * 1456, p[0].payload.size());
+	EXPECT_EQ(8000u, s.bytes());
+	close(sv[0]);
+	close(sv[1]);
+}
+
+TEST(DcaStreamer, InjectsReorderingDuplicatesAndLoss)
+{
+	int sv[2];
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_DGRAM, 0, sv));
+	std::vector<uint8_t> frame(4 * 1456);
+
+	dca_impairments swap;
+	swap.reorder = 1;
+	dca_streamer s(sv[0], swap);
+	ASSERT_TRUE(s.send_frame(&frame[0], frame.size()));
+	std::vector<datagram> p = drain(sv[1]);
+	ASSERT_EQ(4u, p.size());
+	EXPECT_EQ(2u, p[0].header.seqn);
+	EXPECT_EQ(1u, p[1].header.seqn);
+	EXPECT_EQ(4u, p[2].header.seqn);
+	EXPECT_EQ(3u, p[3].header.seqn);
+	EXPECT_EQ(2u, s.reordered());
+
+	dca_impairments dup;
+	dup.duplicate = 1;
+	dca_streamer d(sv[0], dup);
+	ASSERT_TRUE(d.send_frame(&frame[0], frame.size()));
+	p = drain(sv[1]);
+	ASSERT_EQ(8u, p.size());
+	EXPECT_EQ(p[0].header.seqn, p[1].header.seqn);
+
+	dca_impairments loss;
+	loss.loss = 1;
+	dca_streamer l(sv[0], loss);
+	ASSERT_TRUE(l.send_frame(&frame[0], frame.size()));
+	ASSERT_TRUE(l.send_frame(&frame[0], frame.size()));
+	EXPECT_TRUE(drain(sv[1]).empty());
+	EXPECT_EQ(8u, l.lost());
+	EXPECT_EQ(2 * frame.size(), l.bytes());
+	close(sv[0]);
+	close(sv[1]);
+}
+
+TEST(Dca1000Emulator, AnswersTheControlClientAndStreamsFrames)
+{
+	mmwave::emulator_config cfg;
+	cfg.frame_bytes = 4000;
+	cfg.frame_rate = 0;
+	cfg.frames = 3;
+	mmwave::dca1000_emulator emu(cfg);
+	ASSERT_TRUE(emu.open()) << emu.error();
+	std::thread t(&mmwave::dca1000_emulator::run, &emu);
+
+	int data = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(mmwave::DCA_DATA_PORT);
+	inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+	ASSERT_EQ(0, bind(data, (sockaddr*)&a, sizeof(a)));
+
+	mmwave::dca1000_control dca;
+	ASSERT_TRUE(dca.open("127.0.0.1", cfg.addr)) << dca.error();
+	mmwave::dca_packet_config packet;
+	packet.delay_us = 0;
+	ASSERT_TRUE(dca.setup(mmwave::dca_fpga_config(), packet)) << dca.error();
+	EXPECT_EQ(898, dca.fpga_version());
+	ASSERT_TRUE(dca.record_start()) << dca.error();
+
+	// 3 frames in 8 full packets and a short one, the first word of frame f is f
+	timeval tv = {1, 0};
+	setsockopt(data, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	uint8_t buf[mmwave::DCA_MAX_PACKET];
+	std::vector<uint8_t> stream;
+	for (uint32_t seqn = 1; seqn <= 9; ++seqn) {
+		ssize_t len = recv(data, buf, sizeof(buf), 0);
+		ASSERT_GT(len, (ssize_t)mmwave::DCA_HEADER_LEN);
+		dca_header h = parse_dca_header(buf);
+		EXPECT_EQ(seqn, h.seqn);
+		EXPECT_EQ(stream.size(), h.bytec);
+		if (seqn < 9) {
+			EXPECT_EQ(mmwave::DCA_MAX_PAYLOAD, len - mmwave::DCA_HEADER_LEN);
+		}
+		stream.insert(stream.end(), buf + mmwave::DCA_HEADER_LEN, buf + len);
+	}
+	ASSERT_EQ(3 * cfg.frame_bytes, stream.size());
+	for (size_t f = 0; f < 3; ++f) {
+		int16_t first;
+		memcpy(&first, &stream[f * cfg.frame_bytes], sizeof(first));
+		EXPECT_EQ((int16_t)f, first);
+	}
+	EXPECT_TRUE(dca.record_stop()) << dca.error();
+	EXPECT_EQ(3u, emu.frames());
+
+	emu.stop();
+	t.join();
+	close(data);
+}
+
+TEST(Dca1000Emulator, FileIsBareAdcDataCutIntoFrames)
+{
+	// 2.5 frames of bare ADC data, no packet headers
+	mmwave::emulator_config cfg;
+	cfg.frame_bytes = 1000;
+	cfg.frame_rate = 0;
+	cfg.frames = 3;
+	cfg.file = "/tmp/test_dca1000_emulator_adc.bin";
+	std::vector<uint8_t> adc(2500);
+	for (size_t i = 0; i < adc.size(); ++i) adc[i] = (uint8_t)(i % 251);
+	FILE* f = fopen(cfg.file.c_str(), "wb");
+	fwrite(&adc[0], 1, adc.size(), f);
+	fclose(f);
+
+	mmwave::dca1000_emulator emu(cfg);
+	ASSERT_TRUE(emu.open()) << emu.error();
+	std::thread t(&mmwave::dca1000_emulator::run, &emu);
+
+	int data = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(mmwave::DCA_DATA_PORT);
+	inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+	ASSERT_EQ(0, bind(data, (sockaddr*)&a, sizeof(a)));
+	timeval tv = {1, 0};
+	setsockopt(data, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	mmwave::dca1000_control dca;
+	ASSERT_TRUE(dca.open("127.0.0.1", cfg.addr)) << dca.error();
+	mmwave::dca_packet_config packet;
+	packet.delay_us = 0;
+	ASSERT_TRUE(dca.setup(mmwave::dca_fpga_config(), packet)) << dca.error();
+	ASSERT_TRUE(dca.record_start()) << dca.error();
+
+	// the file bytes as they are, the partial frame is dropped and it loops
+	uint8_t buf[mmwave::DCA_MAX_PACKET];
+	std::vector<uint8_t> stream;
+	while (stream.size() < 3 * cfg.frame_bytes) {
+		ssize_t len = recv(data, buf, sizeof(buf), 0);
+		ASSERT_GT(len, (ssize_t)mmwave::DCA_HEADER_LEN);
+		EXPECT_EQ(stream.size(), parse_dca_header(buf).bytec);
+		stream.insert(stream.end(), buf + mmwave::DCA_HEADER_LEN, buf + len);
+	}
+	ASSERT_EQ(3 * cfg.frame_bytes, stream.size());
+	for (size_t k = 0; k < stream.size(); ++k) {
+		size_t frame = k / cfg.frame_bytes % 2;
+		ASSERT_EQ(adc[frame * cfg.frame_bytes + k % cfg.frame_bytes], stream[k]) << "byte " << k;
+	}
+	EXPECT_TRUE(dca.record_stop()) << dca.error();
+
+	emu.stop();
+	t.join();
+	close(data);
+
+	// less than a frame is refused
+	cfg.frame_bytes = 4000;
+	mmwave::dca1000_emulator small(cfg);
+	EXPECT_FALSE(small.open());
+	unlink(cfg.file.c_str());
+}
+
+TEST(Dca1000Control, OnlyTheRecordStartedSystemErrorAcknowledges)
+{
+	// a board that answers every command with a SYSTEM_ERROR, status 1 first
+	int board = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(mmwave::DCA_CMD_PORT);
+	inet_pton(AF_INET, "127.0.0.3", &a.sin_addr);
+	ASSERT_EQ(0, bind(board, (sockaddr*)&a, sizeof(a)));
+	std::thread t([board]() {
+		const uint16_t status[2] = {mmwave::DCA_RECORD_STARTED, 4};
+		for (int i = 0; i < 2; ++i) {
+			uint8_t buf[64];
+			sockaddr_in from;
+			socklen_t from_len = sizeof(from);
+			if (recvfrom(board, buf, sizeof(buf), 0, (sockaddr*)&from, &from_len) < 0) return;
+			std::vector<uint8_t> r = mmwave::dca_build_response(mmwave::DCA_SYSTEM_ERROR, status[i]);
+			sendto(board, &r[0], r.size(), 0, (sockaddr*)&from, from_len);
+		}
+	});
+
+	mmwave::dca1000_control dca;
+	ASSERT_TRUE(dca.open("127.0.0.1", "127.0.0.3")) << dca.error();
+	EXPECT_TRUE(dca.record_start()) << dca.error();
+	EXPECT_EQ(0u, dca.system_errors());
+
+	EXPECT_FALSE(dca.record_stop());
+	EXPECT_NE(std::string::npos, dca.error().find("status 4"));
+	EXPECT_NE(std::string::npos, dca.error().find("RECORD_STOP"));
+	EXPECT_EQ(1u, dca.system_errors());
+	t.join();
+	close(board);
+}
+
+TEST(Dca1000Control, OutOfRangePacketDelayIsRefused)
+{
+	// 525 us is more 8 ns ticks than 16 bits hold, it would wrap to 0.7 us
+	mmwave::dca1000_control dca;
+	mmwave::dca_packet_config packet;
+	packet.delay_us = mmwave::DCA_MAX_PACKET_DELAY_US + 1;
+	EXPECT_FALSE(dca.setup(mmwave::dca_fpga_config(), packet));
+	EXPECT_NE(std::string::npos, dca.error().find("packet delay 525 us"));
+}
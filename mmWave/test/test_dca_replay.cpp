@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/dca1000.h"
+#include "mmWave/dca_replay.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+using mmwave::dca_recording;
+using mmwave::dca_replayer;
+using mmwave::replay_config;
+
+namespace
+{
+
+const size_t PAYLOAD = 100;
+
+// a raw capture of 5 packets, the 3rd and 4th swapped on the wire, the last one short
+std::string write_raw()
+{
+	std::string path = "/tmp/test_dca_replay_raw.bin";
+	FILE* f = fopen(path.c_str(), "wb");
+	const uint32_t order[5] = {1, 2, 4, 3, 5};
+	for (int i = 0; i < 5; ++i) {
+		uint8_t header[mmwave::DCA_HEADER_LEN];
+		mmwave::write_dca_header(header, order[i], (order[i] - 1) * PAYLOAD);
+		std::vector<uint8_t> payload(order[i] == 5 ? 40 : PAYLOAD, (uint8_t)order[i]);
+		fwrite(header, 1, sizeof(header), f);
+		fwrite(&payload[0], 1, payload.size(), f);
+	}
+	fclose(f);
+	return path;
+}
+
+int bind_receiver(uint16_t port)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	sockaddr_in a;
+	memset(&a, 0, sizeof(a));
+	a.sin_family = AF_INET;
+	a.sin_port = htons(port);
+	inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+	if (bind(fd, (sockaddr*)&a, sizeof(a)) < 0) {
+		close(fd);
+		return -1;
+	}
+	int rcvbuf = 1 << 20;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	return fd;
+}
+
+}
+
+TEST(DcaRecording, RawCaptureKeepsTheRecordedHeaders)
+{
+	dca_recording rec;
+	ASSERT_TRUE(rec.load(std::vector<std::string>(1, write_raw()), mmwave::RECORDING_RAW, PAYLOAD)) << rec.error();
+	ASSERT_EQ(5u, rec.packets().size());
+	EXPECT_EQ(4u, rec.packets()[2].seqn);
+	EXPECT_EQ(300u, rec.packets()[2].bytec);
+	EXPECT_EQ(4, rec.data()[rec.packets()[2].offset]);
+	EXPECT_EQ(40u, rec.packets()[4].len);
+	EXPECT_EQ(440u, rec.stream_bytes());
+
+	// the wrong packet size does not parse
+	EXPECT_FALSE(rec.load(std::vector<std::string>(1, write_raw()), mmwave::RECORDING_RAW, 90));
+}
+
+TEST(DcaRecording, FramesAreCutIntoPackets)
+{
+	dca_recording rec;
+	ASSERT_TRUE(rec.load(std::vector<std::string>(1, write_raw()), mmwave::RECORDING_FRAMES, PAYLOAD)) << rec.error();
+	// 490 bytes of file
+	ASSERT_EQ(5u, rec.packets().size());
+	EXPECT_EQ(5u, rec.packets()[4].seqn);
+	EXPECT_EQ(400u, rec.packets()[4].bytec);
+	EXPECT_EQ(90u, rec.packets()[4].len);
+}
+
+TEST(DcaReplayer, LoopsContinueTheStreamOnSchedule)
+{
+	int rx = bind_receiver(14398);
+	ASSERT_GE(rx, 0);
+	dca_recording rec;
+	ASSERT_TRUE(rec.load(std::vector<std::string>(1, write_raw()), mmwave::RECORDING_RAW, PAYLOAD)) << rec.error();
+
+	// 2 frames of 200 bytes per loop at 200 fps, 4 frames take 15 ms
+	replay_config cfg;
+	cfg.port = 14398;
+	cfg.frame_bytes = 200;
+	cfg.frame_rate = 200;
+	cfg.packet_delay_ns = 0;
+	cfg.loops = 2;
+	dca_replayer r(rec, cfg);
+	ASSERT_TRUE(r.open()) << r.error();
+	ASSERT_TRUE(r.run()) << r.error();
+	EXPECT_EQ(10u, r.packets());
+	EXPECT_EQ(5u, r.frames());	// the last frame of a loop is the first of the next
+	EXPECT_GE(r.elapsed_ns(), 15000000u);
+	EXPECT_LT(r.elapsed_ns(), 100000000u);
+
+	uint8_t buf[mmwave::DCA_MAX_PACKET];
+	std::vector<mmwave::dca_header> h;
+	ssize_t len;
+	while ((len = recv(rx, buf, sizeof(buf), MSG_DONTWAIT)) > 0) h.push_back(mmwave::parse_dca_header(buf));
+	ASSERT_EQ(10u, h.size());
+	EXPECT_EQ(4u, h[2].seqn);
+	EXPECT_EQ(6u, h[5].seqn);
+	EXPECT_EQ(440u, h[5].bytec);
+	EXPECT_EQ(9u, h[7].seqn);
+	close(rx);
+}
@@ -0,0 +1,323 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/frame_assembler.h"
+#include "mmWave/frame_pool.h"
+#include "mmWave/frame_queue.h"
+
+#include <stdint.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using mmwave::frame_assembler;
+using mmwave::frame_pool;
+using mmwave::frame_queue;
+using mmwave::OVERRUN_BLOCK;
+using mmwave::OVERRUN_DROP_OLDEST;
+
+namespace
+{
+
+// frames of 2 packets of 4 samples, late packets may trail by one packet
+const int64_t FRAME_LEN = 8;
+const int64_t PACKET_LEN = 4;
+const int64_t WINDOW = 4;
+
+// packet k of the stream, every sample is its stream position
+std::vector<int16_t> packet(uint64_t k)
+{
+	std::vector<int16_t> p(PACKET_LEN);
+	for (int64_t i = 0; i < PACKET_LEN; ++i) p[i] = (int16_t)(k * PACKET_LEN + i);
+	return p;
+}
+
+bool add(frame_assembler& a, uint64_t k)
+{
+	std::vector<int16_t> p = packet(k);
+	return a.add_msg((uint32_t)k + 1, k * PACKET_LEN, &p[0], PACKET_LEN, 0);
+}
+
+struct popped
+{
+	mmwave::frame_info info;
+	std::vector<int16_t> data;
+};
+
+// the frames in the queue, their slots go back to the pool
+std::vector<popped> pop_all(frame_pool& pool, frame_queue& queue)
+{
+	std::vector<popped> r;
+	int64_t slot;
+	while (queue.try_pop(slot)) {
+		popped f;
+		f.info = pool.info(slot);
+		f.data.assign(pool.data(slot), pool.data(slot) + FRAME_LEN);
+		r.push_back(f);
+		pool.release(slot);
+	}
+	return r;
+}
+
+}
+
+TEST(FrameAssembler, LostPacketIsAZeroFilledHole)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	add(a, 0);
+	add(a, 2);
+	add(a, 3);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_EQ(2u, f.size());
+	EXPECT_EQ(1u, f[0].info.packets);
+	EXPECT_EQ(1u, f[0].info.lost_packets);
+	EXPECT_EQ((uint64_t)PACKET_LEN, f[0].info.zero_filled);
+	EXPECT_EQ(0, f[0].data[4]);
+	EXPECT_EQ(0, f[0].data[7]);
+	EXPECT_EQ(0u, f[1].info.lost_packets);
+	EXPECT_EQ(FRAME_LEN, f[1].data[0]);
+	EXPECT_EQ(1u, a.lost_packets());
+	EXPECT_EQ((uint64_t)PACKET_LEN, a.zero_filled());
+}
+
+TEST(FrameAssembler, LatePacketIsPutBackInItsHole)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	// packet 1 trails packet 2 by the whole window, across the frame boundary
+	add(a, 0);
+	add(a, 2);
+	EXPECT_TRUE(add(a, 1));
+	add(a, 3);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_EQ(2u, f.size());
+	for (int64_t i = 0; i < FRAME_LEN; ++i) EXPECT_EQ(i, f[0].data[i]);
+	EXPECT_EQ(2u, f[0].info.packets);
+	EXPECT_EQ(1u, f[0].info.reordered);
+	EXPECT_EQ(0u, f[0].info.lost_packets);
+	EXPECT_EQ(0u, f[0].info.zero_filled);
+	EXPECT_EQ(1u, a.reordered());
+	EXPECT_EQ(0u, a.zero_filled());
+	EXPECT_EQ(0u, a.lost_packets());
+}
+
+TEST(FrameAssembler, PacketBeyondTheWindowOrDuplicateIsStale)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	add(a, 0);
+	add(a, 2);
+	add(a, 3);
+	// frame 0 went out when packet 3 came
+	EXPECT_FALSE(add(a, 1));
+	EXPECT_FALSE(add(a, 3));
+	EXPECT_EQ(2u, a.stale_packets());
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_EQ(1u, f.size());
+	EXPECT_EQ(1u, f[0].info.lost_packets);
+	EXPECT_EQ(0, f[0].data[4]);
+}
+
+TEST(FrameAssembler, KernelDropsAreBlamedFirst)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	// packets 1 and 2 lost, the socket dropped one
+	add(a, 0);
+	a.set_kernel_drops(1);
+	add(a, 3);
+	add(a, 4);
+	add(a, 5);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_EQ(3u, f.size());
+	EXPECT_EQ(1u, f[0].info.lost_packets);
+	EXPECT_EQ(1u, f[0].info.kernel_drops);
+	EXPECT_EQ(1u, f[1].info.lost_packets);
+	EXPECT_EQ(0u, f[1].info.kernel_drops);
+	EXPECT_EQ(2u, a.lost_packets());
+	EXPECT_EQ(1u, a.kernel_lost());
+	EXPECT_EQ(1u, a.wire_lost());
+}
+
+TEST(FrameAssembler, FlushHandsOutTheLastFrames)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	for (uint64_t k = 0; k < 4; ++k) add(a, k);
+	// frame 1 is complete but the window has not moved past it
+	EXPECT_EQ(1u, a.frames());
+	EXPECT_EQ(1u, a.held_frames());
+
+	a.flush();
+	EXPECT_EQ(2u, a.frames());
+	EXPECT_EQ(0u, a.held_frames());
+	int64_t slot;
+	ASSERT_TRUE(queue.try_pop(slot));
+	EXPECT_EQ(0u, pool.info(slot).index);
+	pool.release(slot);
+	ASSERT_TRUE(queue.try_pop(slot));
+	EXPECT_EQ(1u, pool.info(slot).index);
+	EXPECT_EQ(2u, pool.info(slot).packets);
+	EXPECT_EQ(FRAME_LEN + 5, pool.data(slot)[5]);
+	pool.release(slot);
+
+	// a new session from byte count 0 starts clean, nothing of the old one comes out
+	for (uint64_t k = 0; k < 4; ++k) add(a, k);
+	EXPECT_EQ(1u, a.resyncs());
+	EXPECT_EQ(3u, a.frames());
+	ASSERT_TRUE(queue.try_pop(slot));
+	EXPECT_EQ(0u, pool.info(slot).index);
+	EXPECT_FALSE(queue.try_pop(slot));
+}
+
+TEST(FrameAssembler, FirstPacketStartsAtItsOffsetInAFrame)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, WINDOW);
+
+	// capture starts while the board is in the middle of frame 1
+	add(a, 3);
+	add(a, 4);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_EQ(1u, f.size());
+	EXPECT_EQ(1u, f[0].info.index);
+	EXPECT_EQ((uint64_t)PACKET_LEN, f[0].info.zero_filled);
+	EXPECT_EQ(0, f[0].data[3]);
+	EXPECT_EQ(3 * PACKET_LEN, f[0].data[4]);
+	// the first sync is not a resync
+	EXPECT_EQ(0u, a.resyncs());
+}
+
+TEST(FrameAssembler, RestartedByteCounterResyncs)
+{
+	// room for the frames held across the restart
+	frame_pool pool(FRAME_LEN, 6);
+	frame_queue queue(8);
+	frame_assembler a(pool, queue, WINDOW);
+
+	for (uint64_t k = 0; k < 7; ++k) add(a, k);
+	EXPECT_EQ(2u, pop_all(pool, queue).size());
+
+	// back to 0 with half of frame 3 filled, a late packet would be closer
+	add(a, 0);
+	EXPECT_EQ(1u, a.resyncs());
+	EXPECT_EQ(1u, a.dropped_frames());
+	add(a, 1);
+	add(a, 2);
+	add(a, 3);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	// frame 2 held at the restart, then the new frames 0 and 1
+	ASSERT_EQ(3u, f.size());
+	EXPECT_EQ(2u, f[0].info.index);
+	EXPECT_EQ(0u, f[1].info.index);
+	EXPECT_EQ(0u, f[1].info.zero_filled);
+	for (int64_t i = 0; i < FRAME_LEN; ++i) EXPECT_EQ(i, f[1].data[i]);
+	EXPECT_EQ(1u, f[2].info.index);
+	EXPECT_EQ(0u, a.stale_packets());
+}
+
+TEST(FrameAssembler, SplitHoleBeyondTheHoleLimitIsCountedLost)
+{
+	// 64 holes of 3 packets in one held frame, every 4th packet arrives
+	frame_pool pool(1024, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, 1024);
+	for (uint64_t k = 0; k <= 256; k += 4) add(a, k);
+	EXPECT_EQ(0u, a.lost_packets());
+
+	// the middle of the first hole, its left part no longer fits the list
+	EXPECT_TRUE(add(a, 2));
+	EXPECT_EQ(1u, a.lost_packets());
+	EXPECT_FALSE(add(a, 1));
+	EXPECT_TRUE(add(a, 3));
+
+	a.flush();
+	EXPECT_EQ(2u, a.reordered());
+	EXPECT_EQ(64u * 3 - 2, a.lost_packets());
+}
+
+TEST(FrameAssembler, DropOldestTakesBackWhatTheConsumerDidNotTake)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, 0, OVERRUN_DROP_OLDEST);
+
+	// nobody pops, 8 frames
+	for (uint64_t k = 0; k < 16; ++k) add(a, k);
+	a.flush();
+	std::vector<popped> f = pop_all(pool, queue);
+	ASSERT_FALSE(f.empty());
+	EXPECT_LT(0u, a.overwritten_frames());
+	EXPECT_EQ(a.overwritten_frames(), a.dropped_frames());
+	// stolen frames are not counted as handed out
+	EXPECT_EQ(f.size(), a.frames());
+	EXPECT_EQ(8u, a.frames() + a.dropped_frames());
+	// the newest frames survive, in order
+	for (size_t i = 0; i < f.size(); ++i) EXPECT_EQ(8 - f.size() + i, f[i].info.index);
+}
+
+TEST(FrameAssembler, BlockGivesUpOnceThenDropsNewest)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, 0, OVERRUN_BLOCK, 20);
+
+	for (uint64_t k = 0; k < 16; ++k) add(a, k);
+	// one wait for the stalled consumer, not one per frame
+	EXPECT_EQ(1u, a.blocked());
+	EXPECT_EQ(1u, a.block_timeouts());
+	EXPECT_LE(20000000u, a.blocked_ns());
+	EXPECT_LT(0u, a.dropped_frames());
+	EXPECT_EQ(0u, a.overwritten_frames());
+
+	// a released slot ends the drops, the next overrun waits again
+	pop_all(pool, queue);
+	for (uint64_t k = 16; k < 32; ++k) add(a, k);
+	EXPECT_EQ(2u, a.blocked());
+	EXPECT_EQ(2u, a.block_timeouts());
+}
+
+TEST(FrameAssembler, BlockWaitsForTheConsumerToRelease)
+{
+	frame_pool pool(FRAME_LEN, 4);
+	frame_queue queue(4);
+	frame_assembler a(pool, queue, 0, OVERRUN_BLOCK, 1000);
+
+	const uint64_t num_frames = 10;
+	std::vector<uint64_t> index;
+	std::thread consumer([&]() {
+		int64_t slot;
+		while (index.size() < num_frames && queue.pop(slot, 2000)) {
+			// a slow consumer, the producer runs out of slots
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+			index.push_back(pool.info(slot).index);
+			pool.release(slot);
+		}
+	});
+	for (uint64_t k = 0; k < 2 * num_frames; ++k) add(a, k);
+	a.flush();
+	consumer.join();
+
+	EXPECT_LT(0u, a.blocked());
+	EXPECT_EQ(0u, a.block_timeouts());
+	EXPECT_EQ(0u, a.dropped_frames());
+	EXPECT_EQ(num_frames, a.frames());
+	ASSERT_EQ(num_frames, index.size());
+	for (size_t i = 0; i < index.size(); ++i) EXPECT_EQ(i, index[i]);
+}
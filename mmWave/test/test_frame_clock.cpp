@@ -0,0 +1,111 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/frame_clock.h"
+
+#include <stdint.h>
+
+using mmwave::frame_clock;
+
+namespace
+{
+
+const double PERIOD = 10000000.0;	// 10 ms frames
+const uint64_t T0 = 1000000000000ull;
+
+// host side latency of frame k, a few us that look random
+int64_t jitter(uint64_t k)
+{
+	return (int64_t)((k * 7919) % 11) * 1000 - 5000;
+}
+
+uint64_t stamp(uint64_t k, double period = PERIOD)
+{
+	return T0 + (uint64_t)(period * k) + jitter(k);
+}
+
+}
+
+TEST(FrameClock, RawTimesUntilLocked)
+{
+	frame_clock c(PERIOD);
+	for (uint64_t k = 0; k + 1 < frame_clock::MIN_FRAMES; ++k) {
+		EXPECT_EQ(stamp(k), c.update(k, stamp(k)));
+		EXPECT_FALSE(c.locked());
+	}
+	// a frame without packets has no time yet
+	EXPECT_EQ(0u, c.update(100, 0));
+	c.update(frame_clock::MIN_FRAMES - 1, stamp(frame_clock::MIN_FRAMES - 1));
+	EXPECT_TRUE(c.locked());
+}
+
+TEST(FrameClock, OutlierIsRejected)
+{
+	frame_clock c(PERIOD);
+	for (uint64_t k = 0; k < 20; ++k) c.update(k, stamp(k));
+
+	// frame 20 stuck 2 ms in the host
+	uint64_t t = c.update(20, stamp(20) + 2000000);
+	EXPECT_EQ(1u, c.outliers());
+	EXPECT_NEAR((double)(T0 + 20 * PERIOD), (double)t, 10000);
+
+	for (uint64_t k = 21; k < 40; ++k) c.update(k, stamp(k));
+	EXPECT_EQ(1u, c.outliers());
+	EXPECT_EQ(0u, c.resets());
+	EXPECT_NEAR(PERIOD, c.period(), 100);
+	// the outlier is not in the jitter
+	EXPECT_GT(5000, c.jitter());
+	// lost frames are put on the line
+	EXPECT_NEAR((double)(T0 + 41 * PERIOD), (double)c.update(41, 0), 10000);
+}
+
+TEST(FrameClock, RunOfOutliersResets)
+{
+	frame_clock c(PERIOD);
+	for (uint64_t k = 0; k < 32; ++k) c.update(k, stamp(k));
+
+	// the radar restarted 3 ms later, the index carries on
+	for (uint64_t k = 32; k < 32 + frame_clock::MAX_OUTLIER_RUN; ++k) c.update(k, stamp(k) + 3000000);
+	EXPECT_EQ((uint64_t)frame_clock::MAX_OUTLIER_RUN, c.outliers());
+	EXPECT_EQ(0u, c.resets());
+	EXPECT_TRUE(c.locked());
+
+	uint64_t k = 32 + frame_clock::MAX_OUTLIER_RUN;
+	EXPECT_EQ(stamp(k) + 3000000, c.update(k, stamp(k) + 3000000));
+	EXPECT_EQ(1u, c.resets());
+	EXPECT_FALSE(c.locked());
+
+	// the new model locks to the shifted line
+	for (++k; k < 48; ++k) c.update(k, stamp(k) + 3000000);
+	EXPECT_TRUE(c.locked());
+	EXPECT_NEAR((double)(T0 + 3000000 + 48 * PERIOD), (double)c.update(48, 0), 10000);
+}
+
+TEST(FrameClock, IndexGoingBackResets)
+{
+	frame_clock c(PERIOD);
+	for (uint64_t k = 0; k < 16; ++k) c.update(k, stamp(k));
+	EXPECT_TRUE(c.locked());
+	c.update(0, stamp(16));
+	EXPECT_EQ(1u, c.resets());
+	EXPECT_FALSE(c.locked());
+}
+
+TEST(FrameClock, DriftAgainstTheNominalPeriod)
+{
+	// radar frames 50 ppm longer than configured
+	double period = PERIOD * (1 + 50e-6);
+	frame_clock c(PERIOD);
+	for (uint64_t k = 0; k < 256; ++k) c.update(k, stamp(k, period));
+	EXPECT_NEAR(50, c.drift_ppm(), 1);
+	EXPECT_NEAR(period, c.period(), 10);
+
+	frame_clock fast(PERIOD);
+	for (uint64_t k = 0; k < 256; ++k) fast.update(k, stamp(k, PERIOD * (1 - 20e-6)));
+	EXPECT_NEAR(-20, fast.drift_ppm(), 1);
+
+	// no nominal period, no drift
+	frame_clock unknown(0);
+	for (uint64_t k = 0; k < 16; ++k) unknown.update(k, stamp(k, period));
+	EXPECT_EQ(0, unknown.drift_ppm());
+	EXPECT_NEAR(period, unknown.period(), 1000);
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/circ_buff.h"
+#include "mmWave/frame_pool.h"
+
+#include <stdint.h>
+#include <string.h>
+
+using mmwave::frame_pool;
+
+TEST(FramePool, HandsOutEverySlotOnceInRingOrder)
+{
+	frame_pool pool(16, 3);
+	EXPECT_EQ(0, pool.acquire());
+	EXPECT_EQ(1, pool.acquire());
+	EXPECT_EQ(2, pool.acquire());
+	EXPECT_EQ(-1, pool.acquire());
+	EXPECT_EQ(3, pool.in_use());
+
+	pool.release(1);
+	EXPECT_EQ(2, pool.in_use());
+	EXPECT_EQ(1, pool.acquire());
+	EXPECT_EQ(-1, pool.acquire());
+
+	// the cursor goes on after the last slot taken
+	pool.release(0);
+	pool.release(2);
+	EXPECT_EQ(2, pool.acquire());
+	EXPECT_EQ(0, pool.acquire());
+}
+
+TEST(FramePool, SlotIsOnlyReusedWhenTheLastReferenceIsGone)
+{
+	frame_pool pool(16, 2);
+	int64_t a = pool.acquire();
+	int64_t b = pool.acquire();
+	pool.retain(a);
+	pool.release(a);
+	EXPECT_EQ(-1, pool.acquire());
+	pool.release(a);
+	EXPECT_EQ(a, pool.acquire());
+	pool.release(a);
+	pool.release(b);
+	EXPECT_EQ(0, pool.in_use());
+}
+
+TEST(FramePool, SlotsAreFrameLenApart)
+{
+	frame_pool pool(1000, 4);
+	EXPECT_EQ(1000, pool.frame_len());
+	EXPECT_EQ(4, pool.num_slots());
+	for (int64_t s = 0; s < 4; ++s) {
+		EXPECT_EQ(pool.data(0) + s * 1000, pool.data(s));
+		for (int64_t i = 0; i < 1000; ++i) pool.data(s)[i] = (int16_t)s;
+		pool.info(s).index = s;
+	}
+	for (int64_t s = 0; s < 4; ++s) {
+		EXPECT_EQ(s, pool.data(s)[0]);
+		EXPECT_EQ(s, pool.data(s)[999]);
+		EXPECT_EQ((uint64_t)s, pool.info(s).index);
+	}
+}
+
+TEST(AllocRing, NormalPagesAre2MBAlignedAndZeroed)
+{
+	// not a multiple of 2 MB, the mapping is rounded up
+	const int64_t len = (3 << 20) + 17;
+	int mode = -1;
+	int16_t* ring = alloc_ring(len, 0, &mode);
+	ASSERT_TRUE(ring != NULL);
+	EXPECT_EQ(RING_PAGES_NORMAL, mode);
+	EXPECT_EQ(0u, (uintptr_t)ring & ((2 << 20) - 1));
+	EXPECT_EQ(0, ring[0]);
+	EXPECT_EQ(0, ring[len - 1]);
+	memset(ring, 0x55, len * sizeof(int16_t));
+	free_ring(ring, len);
+}
+
+TEST(AllocRing, HugePagesFallBackToWhatTheHostHas)
+{
+	const int64_t len = 4 << 20;
+	frame_pool pool(len / 2, 2, true);
+	int mode = pool.page_mode();
+	EXPECT_TRUE(mode == RING_PAGES_NORMAL || mode == RING_PAGES_HUGETLB || mode == RING_PAGES_THP);
+	// usable to the last word whatever it got
+	memset(pool.data(0), 0x55, len * sizeof(int16_t));
+	EXPECT_EQ(0x5555, pool.data(1)[len / 2 - 1]);
+}
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/frame_queue.h"
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using mmwave::frame_queue;
+
+TEST(FrameQueue, IsABoundedFifo)
+{
+	frame_queue q(3);
+	// rounded up to a power of two
+	ASSERT_EQ(4u, q.capacity());
+	for (int64_t i = 0; i < 4; ++i) EXPECT_TRUE(q.push(i));
+	EXPECT_FALSE(q.push(4));
+	EXPECT_EQ(4u, q.depth());
+	EXPECT_EQ(4u, q.high_water());
+
+	int64_t slot;
+	for (int64_t i = 0; i < 4; ++i) {
+		ASSERT_TRUE(q.try_pop(slot));
+		EXPECT_EQ(i, slot);
+	}
+	EXPECT_FALSE(q.try_pop(slot));
+	EXPECT_EQ(0u, q.depth());
+	EXPECT_EQ(4u, q.high_water());
+}
+
+TEST(FrameQueue, PopSleepsUntilAPushOrTheTimeout)
+{
+	frame_queue q(4);
+	int64_t slot;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	EXPECT_FALSE(q.pop(slot, 20));
+	EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+
+	std::thread producer([&q]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		q.push(7);
+	});
+	ASSERT_TRUE(q.pop(slot, 1000));
+	EXPECT_EQ(7, slot);
+	producer.join();
+}
+
+TEST(FrameQueue, StealTakesTheOldestEntry)
+{
+	frame_queue q(4);
+	q.push(1);
+	q.push(2);
+	int64_t slot;
+	ASSERT_TRUE(q.steal(slot));
+	EXPECT_EQ(1, slot);
+	ASSERT_TRUE(q.try_pop(slot));
+	EXPECT_EQ(2, slot);
+	EXPECT_FALSE(q.steal(slot));
+}
+
+// the producer steals whenever the queue is full while the consumer pops,
+// every entry must come out exactly once and in order on each side
+TEST(FrameQueue, StealAndTryPopNeverShareAnEntry)
+{
+	const int64_t N = 200000;
+	frame_queue q(4);
+	std::vector<int64_t> popped, stolen;
+	popped.reserve(N);
+	stolen.reserve(N);
+	std::atomic<bool> done(false);
+
+	std::thread consumer([&]() {
+		int64_t slot;
+		for (;;) {
+			// done before the pop, the last push may land between the two
+			bool last = done;
+			if (q.try_pop(slot))
+				popped.push_back(slot);
+			else if (last)
+				break;
+		}
+	});
+	for (int64_t i = 0; i < N; ++i) {
+		int64_t slot;
+		while (!q.push(i))
+			if (q.steal(slot)) stolen.push_back(slot);
+	}
+	done = true;
+	consumer.join();
+
+	EXPECT_EQ((size_t)N, popped.size() + stolen.size());
+	std::vector<int> seen(N, 0);
+	for (size_t i = 0; i < popped.size(); ++i) {
+		++seen[popped[i]];
+		if (i > 0) {
+			EXPECT_LT(popped[i - 1], popped[i]);
+		}
+	}
+	for (size_t i = 0; i < stolen.size(); ++i) {
+		++seen[stolen[i]];
+		if (i > 0) {
+			EXPECT_LT(stolen[i - 1], stolen[i]);
+		}
+	}
+	for (int64_t i = 0; i < N; ++i) ASSERT_EQ(1, seen[i]) << "entry " << i;
+}
@@ -0,0 +1,55 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/frame_view.h"
+
+#include <stdexcept>
+#include <vector>
+
+using mmwave::chirp_layout;
+using mmwave::complex_lanes;
+using mmwave::frame_view;
+using mmwave::real_lanes;
+
+TEST(FrameView, ComplexLanesFollowTheReshapeOfFftViz)
+{
+	// 2 chirps of 3 samples on 4 lanes, I0..I3 Q0..Q3 per sample
+	typedef chirp_layout<complex_lanes<4> > layout;
+	std::vector<int16_t> words(2 * 3 * 8);
+	for (size_t k = 0; k < words.size(); ++k) words[k] = (int16_t)k;
+
+	frame_view<layout> v(&words[0], words.size(), 2, 3);
+	EXPECT_EQ(4, v.lanes());
+	EXPECT_EQ(0, v.at(0, 0).i[0]);
+	EXPECT_EQ(4, v.at(0, 0).q[0]);
+	EXPECT_EQ(std::complex<float>(11, 15), v.at(0, 1).rx(3));
+	EXPECT_EQ(24, v.at(1, 0).i[0]);
+	EXPECT_TRUE(v.cp(1) == NULL);
+}
+
+TEST(FrameView, ChirpParametersBeforeAndAfterTheSamples)
+{
+	// 2 lanes, 2 samples, 4 CP words per chirp
+	std::vector<int16_t> words(2 * (4 + 2 * 2));
+	for (size_t k = 0; k < words.size(); ++k) words[k] = (int16_t)k;
+
+	frame_view<chirp_layout<real_lanes<2>, mmwave::CP_BEFORE, 4> > before(&words[0], words.size(), 2, 2);
+	EXPECT_EQ(0, before.cp(0)[0]);
+	EXPECT_EQ(4, before.at(0, 0).v[0]);
+	EXPECT_EQ(8, before.cp(1)[0]);
+	EXPECT_EQ(15, before.at(1, 1).v[1]);
+
+	frame_view<chirp_layout<real_lanes<2>, mmwave::CP_AFTER, 4> > after(&words[0], words.size(), 2, 2);
+	EXPECT_EQ(0, after.at(0, 0).v[0]);
+	EXPECT_EQ(4, after.cp(0)[0]);
+	EXPECT_EQ(8, after.at(1, 0).v[0]);
+	EXPECT_EQ(12, after.cp(1)[0]);
+}
+
+TEST(FrameView, LengthMustMatchTheLayout)
+{
+	typedef chirp_layout<complex_lanes<4> > layout;
+	std::vector<int16_t> words(2 * 3 * 8 + 1);
+	EXPECT_FALSE(frame_view<layout>::fits(words.size(), 2, 3));
+	EXPECT_TRUE(frame_view<layout>::fits(words.size() - 1, 2, 3));
+	EXPECT_THROW(frame_view<layout>(&words[0], words.size(), 2, 3), std::length_error);
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "mmWave/iwr_cli.h"
+
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mmwave::iwr_cli;
+
+namespace
+{
+
+const char* PROMPT = "LVDS Stream:/>";
+
+// the CLI task of cli.c on the other end of a pty: echo, Done or Error, prompt
+class fake_radar
+{
+public:
+	fake_radar() : running_(true)
+	{
+		openpty(&master_, &slave_, NULL, NULL, NULL);
+		termios t;
+		tcgetattr(slave_, &t);
+		cfmakeraw(&t);
+		tcsetattr(slave_, TCSANOW, &t);
+		thread_ = std::thread(&fake_radar::run, this);
+	}
+
+	~fake_radar()
+	{
+		running_ = false;
+		thread_.join();
+		close(master_);
+		close(slave_);
+	}
+
+	std::string tty() const { return ttyname(slave_); }
+	std::vector<std::string> received;
+
+private:
+	void say(const std::string& s)
+	{
+		if (write(master_, s.data(), s.size()) < 0) return;
+	}
+
+	void run()
+	{
+		std::string line;
+		while (running_) {
+			char c;
+			pollfd pfd = {master_, POLLIN, 0};
+			if (poll(&pfd, 1, 10) <= 0 || read(master_, &c, 1) != 1) continue;
+			if (c != '\r') {
+				line += c;
+				continue;
+			}
+			received.push_back(line);
+			say(line + "\r\n");
+			if (line.empty())
+				;
+			else if (line == "silent")
+				continue;
+			else if (line == "bogus")
+				say("'bogus' is not recognized as a CLI command\n");
+			else if (line.compare(0, 10, "profileCfg") == 0)
+				say("Error: Invalid usage of the CLI command\nError -3\n");
+			else
+				say("Done\n'" + line.substr(0, line.find(' ')) + "'\n");
+			say(PROMPT);
+			line.clear();
+		}
+	}
+
+	int master_;
+	int slave_;
+	std::atomic<bool> running_;
+	std::thread thread_;
+};
+
+}
+
+TEST(IwrCli, ConfigureWaitsForThePromptOfEachLine)
+{
+	fake_radar radar;
+	iwr_cli cli;
+	ASSERT_TRUE(cli.open(radar.tty(), 115200, PROMPT)) << cli.error();
+	ASSERT_TRUE(cli.sync()) << cli.error();
+
+	std::vector<std::string> cfg;
+	cfg.push_back("sensorStop");
+	cfg.push_back("");
+	cfg.push_back("channelCfg 15 1 0");
+	ASSERT_TRUE(cli.configure(cfg)) << cli.error();
+	EXPECT_EQ("Done\n'channelCfg'\n", cli.response());
+	ASSERT_EQ(3u, radar.received.size());
+	EXPECT_EQ("channelCfg 15 1 0", radar.received[2]);
+}
+
+TEST(IwrCli, FirstErrorStopsTheUpload)
+{
+	fake_radar radar;
+	iwr_cli cli;
+	ASSERT_TRUE(cli.open(radar.tty(), 115200, PROMPT)) << cli.error();
+
+	std::vector<std::string> cfg;
+	cfg.push_back("profileCfg 0 77 7 7 58 0 0 68 1 256 5500 0 0 30");
+	cfg.push_back("sensorStart");
+	EXPECT_FALSE(cli.configure(cfg));
+	EXPECT_EQ(-3, cli.error_code());
+	EXPECT_NE(std::string::npos, cli.error().find("Invalid usage"));
+	EXPECT_EQ(1u, radar.received.size());
+
+	EXPECT_FALSE(cli.command("bogus"));
+	EXPECT_EQ(-1, cli.error_code());
+}
+
+TEST(IwrCli, SilenceFailsAfterTheTimeout)
+{
+	fake_radar radar;
+	iwr_cli cli;
+	ASSERT_TRUE(cli.open(radar.tty(), 115200, PROMPT)) << cli.error();
+	cli.set_timeout(50);
+	EXPECT_FALSE(cli.command("silent"));
+	EXPECT_NE(std::string::npos, cli.error().find("no prompt"));
+}